@@ -1,4 +1,5 @@
 #include <sstream>
+#include <BearLibTerminal.h>
 #include "world.h"
 
 Dir getDir(World &w, const std::string &reason);
@@ -8,56 +9,6 @@ bool actionMove(World &w, Actor *player, const Command &command, bool silent);
 void viewLog(World &w);
 
 
-void makeLootAt(World &w, const LootTable *table, const Point &where, bool showMessages) {
-    if (!table || table->mRows.empty()) return;
-
-    Inventory inv;
-    for (const LootRow &row : table->mRows) {
-        if (row.ident < 0 || row.chance < 0 || row.max < 0) continue;
-        const ItemDef &def = w.getItemDef(row.ident);
-        if (def.ident < 0) continue;
-        int chance = w.getRandom().next32() % 100;
-        int qty = w.getRandom().between(row.min, row.max);
-        if (chance < row.chance) inv.add(&def, qty);
-    }
-
-    std::stringstream s;
-    for (InventoryRow &row : inv.mContents) {
-        int realDropped = 0;
-        for (int i = 0; i < row.qty; ++i ) {
-            Point dest = w.findDropSpace(where);
-            if (w.valid(dest)) {
-                Item *item = new Item(*row.def);
-                if (!w.moveItem(item, dest)) {
-                    delete item;
-                } else {
-                    ++realDropped;
-                }
-            }
-        }
-        row.qty = realDropped;
-    }
-
-    inv.cleanup();
-    if (inv.mContents.empty()) return;
-    s << " Dropped";
-    const unsigned invSize = inv.mContents.size();
-    for (unsigned i = 0; i < invSize; ++i) {
-        if (i != 0 && invSize > 2) s << ",";
-        if (i == invSize - 1 && invSize > 1) s << " and";
-        const InventoryRow &row = inv.mContents[i];
-        if (row.qty > 1) {
-            s << ' ' << row.qty << ' ' << row.def->plural;
-        } else {
-            s << " a " << row.def->name;
-        }
-    }
-    s << '.';
-    if (showMessages) w.appendLogMsg(s.str());
-}
-
-
-
 void shiftCameraForMove(World &w, Actor *player) {
     const int screenWidth = 80;
     const int screenHeight = 25;
@@ -118,11 +69,7 @@ bool actionAttack(World &w, Actor *player, const Command &command, bool silent)
 
 
 bool actionCentrePan(World &w, Actor *player, const Command &command, bool silent) {
-    const int viewWidth = 25;
-    const int viewHeight = 25;
-
-    Point dest(player->pos.x - viewWidth / 2, player->pos.y - viewHeight / 2);
-    w.setCamera(dest);
+    w.centreCamera(player->pos);
     return false;
 }
 
@@ -222,22 +169,19 @@ bool actionDrop(World &w, Actor *player, const Command &command, bool silent) {
         return false;
     }
 
-    Point dropAt = w.findDropSpace(player->pos);
-    if (!w.valid(dropAt) || w.at(dropAt).item) {
+    const ItemDef *def = player->inventory.mContents[w.selection].def;
+    Point dropAt = w.findDropSpace(player->pos, def->ident);
+    if (!w.valid(dropAt)) {
         w.addLogMsg("No space to drop item.");
         return false;
     }
 
-    const ItemDef *def = player->inventory.mContents[w.selection].def;
-    Item *item = new Item(*def);
-    if (w.moveItem(item, dropAt)) {
+    if (w.addItems(dropAt, def->ident, 1)) {
         player->inventory.remove(def);
         w.addLogMsg("Dropped " + def->name + ".");
         if (w.selection > 0 && w.selection >= player->inventory.size()) {
             w.selection = player->inventory.size() - 1;
         }
-    } else {
-        delete item;
     }
 
     return true;
@@ -275,7 +219,7 @@ bool actionMove(World &w, Actor *player, const Command &command, bool silent) {
         return false;
     } else {
         const Tile &tile = w.at(player->pos);
-        if (tile.item) {
+        if (!tile.item.empty()) {
             actionTake(w, player, command, true);
         }
         shiftCameraForMove(w, player);
@@ -333,16 +277,16 @@ bool actionSavegame(World &w, Actor *player, const Command &command, bool silent
 
 
 bool actionTake(World &w, Actor *player, const Command &command, bool silent) {
-    Item *item = w.at(player->pos).item;
-    if (!item) {
+    ItemStack stack = w.at(player->pos).item;
+    if (stack.empty()) {
         w.addLogMsg("Nothing to take.");
         return false;
     }
 
-    if (player->inventory.add(&item->def)) {
-        w.removeItem(item);
-        w.addLogMsg("Took " + item->getName(false) + ".");
-        delete item;
+    const ItemDef &def = w.getItemDef(stack.ident);
+    if (player->inventory.add(&def, stack.qty)) {
+        w.setItems(player->pos, ItemStack());
+        w.addLogMsg("Took " + itemStackName(def, stack.qty) + ".");
         return true;
     }
     return false;
@@ -422,14 +366,15 @@ bool actionUse(World &w, Actor *player, const Command &command, bool silent) {
         Point dest = player->pos.shift(d);
         const Tile &t = w.at(dest);
         const TileDef &td = w.getTileDef(t.terrain);
-        if (!td.ground || t.building > 0 || t.actor || t.item) {
+        if (!td.ground || t.building > 0 || t.actor || !t.item.empty()) {
             w.addLogMsg("The space isn't clear.");
             return false;
         }
         const ActorDef &actorDef = w.getActorDef(def->seedFor);
         player->inventory.remove(def);
         if (actorDef.ident < 0) return false;
-        Actor *actor = new Actor(actorDef);
+        Actor *actor = w.createActor(actorDef);
+        if (!actor) return false;
         actor->reset();
         w.moveActor(actor, dest);
         return true;
@@ -442,7 +387,7 @@ bool actionUse(World &w, Actor *player, const Command &command, bool silent) {
         Point dest = player->pos.shift(d);
         const Tile &t = w.at(dest);
         const TileDef &td = w.getTileDef(t.terrain);
-        if (!td.ground || t.actor || t.item) {
+        if (!td.ground || t.actor || !t.item.empty()) {
             w.addLogMsg("The space isn't clear.");
             return false;
         }
@@ -472,6 +417,43 @@ bool actionWait(World &w, Actor *player, const Command &command, bool silent) {
 }
 
 
+bool actionRest(World &w, Actor *player, const Command &command, bool silent) {
+    const int maxTurns = w.configData.restMaxTurns;
+    std::string text;
+    if (!ui_prompt("Rest", "Turns to rest (blank until interrupted)", text)) {
+        w.addLogMsg("Canceled.");
+        return false;
+    }
+    int turns = maxTurns;
+    if (!trim(text).empty() && (!strToInt(trim(text), turns) || turns <= 0)) {
+        w.addLogMsg("Turns to rest must be a positive number.");
+        return false;
+    }
+    // a key press can cut the rest short, which the journal cannot repeat
+    w.markJournalGap();
+
+    // the tick has already been taken for each turn, so don't ask for another
+    RestResult result = w.rest(turns, w.configData.restStopOn, w.configData.restRadius, [turns](int done) {
+        ui_MessageBox_Instant("Resting... " + std::to_string(done) + "/" + std::to_string(turns) + " (any key to stop)");
+        if (!terminal_has_input()) return true;
+        terminal_read();
+        return false;
+    });
+
+    std::string msg = "Rested for " + std::to_string(result.turns) + " turns";
+    switch (result.reason) {
+        case REST_HOSTILE:      msg += "; there's a monster nearby."; break;
+        case REST_DAMAGED:      msg += "; something hurt you!"; break;
+        case REST_CROP:         msg += "; a nearby plant is fully grown."; break;
+        case REST_CANCELLED:    msg += "; interrupted."; break;
+        default:                msg += "."; break;
+    }
+    if (result.reason == REST_HOSTILE && result.turns == 0) msg = "You can't rest with a monster nearby.";
+    w.addLogMsg(msg);
+    return false;
+}
+
+
 
 bool actionSelectEnd(World &w, Actor *player, const Command &command, bool silent) {
     if (player->inventory.size() > 0) {
@@ -1,5 +1,143 @@
-#include <cmath>
+#include <algorithm>
+#include <vector>
 #include "world.h"
+#include "worker_pool.h"
+
+// The map is generated in square regions so that each pass can run on
+// several threads at once. Regions are whole chunks, so no two threads ever
+// write to the same chunk, and every region has its own random number
+// stream, so the result does not depend on how many threads were used.
+const int REGION_SIZE = CHUNK_SIZE * 4;
+// features never reach further than this from their centre, so painting a
+// region only has to consider the features of its eight neighbours
+const int MAX_FEATURE_RADIUS = 20;
+static_assert(MAX_FEATURE_RADIUS < REGION_SIZE, "features must not spill past neighbouring regions");
+// attempts made to find an open tile for each plant or NPC in a region
+const int MAX_PLACE_TRIES = 100;
+
+struct Feature {
+    Point centre;
+    int radius;
+};
+
+struct Placement {
+    Point pos;
+    int ident;
+};
+
+struct Region {
+    Point corner;
+    int width, height;
+    Random rng;
+    std::vector<Feature> lakes, mountains, dirt, sand;
+    std::vector<Placement> ores, plants, npcs;
+};
+
+struct MapPlan {
+    int regionsWide, regionsHigh;
+    std::vector<Region> regions;
+    std::vector<int> topBorder, bottomBorder, leftBorder, rightBorder;
+};
+
+static std::uint64_t regionSeed(unsigned long seed, int x, int y) {
+    return mixSeed(mixSeed(mixSeed(seed) ^ x) ^ y);
+}
+
+// Scales a whole map "one per perArea tiles" count down to a single region,
+// using the region's random stream to decide the fractional part.
+static int regionCount(Region &region, int perArea) {
+    int area = region.width * region.height;
+    int count = area / perArea;
+    if (static_cast<int>(region.rng.next32() % perArea) < area % perArea) ++count;
+    return count;
+}
+
+static Point regionPoint(Region &region) {
+    Point p;
+    p.x = region.corner.x + region.rng.next32() % region.width;
+    p.y = region.corner.y + region.rng.next32() % region.height;
+    return p;
+}
+
+static void planFeatures(Region &region, std::vector<Feature> &list, int perArea, int minRadius, int maxRadius) {
+    int count = regionCount(region, perArea);
+    for (int i = 0; i < count; ++i) {
+        Feature feature;
+        feature.radius = region.rng.between(minRadius, maxRadius);
+        feature.centre = regionPoint(region);
+        list.push_back(feature);
+    }
+}
+
+// Draws one pass worth of features from this region and its neighbours,
+// clipped to the region itself.
+static void paintFeatures(World &w, MapPlan &plan, int index,
+                          std::vector<Feature> Region::*list,
+                          int layer, int tile, int onlyOver) {
+    const Region &region = plan.regions[index];
+    int rx = index % plan.regionsWide;
+    int ry = index / plan.regionsWide;
+    for (int ny = std::max(ry - 1, 0); ny <= std::min(ry + 1, plan.regionsHigh - 1); ++ny) {
+        for (int nx = std::max(rx - 1, 0); nx <= std::min(rx + 1, plan.regionsWide - 1); ++nx) {
+            const Region &other = plan.regions[nx + ny * plan.regionsWide];
+            for (const Feature &f : other.*list) {
+                w.fillDiscClipped(layer, f.centre, f.radius, tile, onlyOver,
+                                  region.corner, region.width, region.height);
+            }
+        }
+    }
+}
+
+static void paintBorders(World &w, MapPlan &plan, int index) {
+    const Region &region = plan.regions[index];
+    int left = region.corner.x, right = region.corner.x + region.width - 1;
+    int top = region.corner.y, bottom = region.corner.y + region.height - 1;
+    const int maxDepth = 5;
+    if (left >= maxDepth && top >= maxDepth
+            && right < w.width() - maxDepth && bottom < w.height() - maxDepth) {
+        return;
+    }
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            if (y < plan.topBorder[x] || y >= w.height() - plan.bottomBorder[x]
+                    || x < plan.leftBorder[y] || x >= w.width() - plan.rightBorder[y]) {
+                Point p(x, y);
+                w.setRaw(LAYER_TERRAIN, p, TILE_OCEAN);
+                w.setRaw(LAYER_BUILDING, p, 0);
+            }
+        }
+    }
+}
+
+static void planPlacements(World &w, Region &region, std::vector<char> &used,
+                           std::vector<Placement> &list, int perArea,
+                           const int *idents, int identCount) {
+    int count = regionCount(region, perArea);
+    for (int i = 0; i < count; ++i) {
+        for (int tries = 0; tries < MAX_PLACE_TRIES; ++tries) {
+            Point p = regionPoint(region);
+            int cell = (p.x - region.corner.x) + (p.y - region.corner.y) * region.width;
+            if (used[cell]) continue;
+            if (w.getBuilding(p) > 0) continue;
+            if (w.getTileFlags(w.getTerrain(p)) & TF_SOLID) continue;
+            used[cell] = true;
+            list.push_back(Placement{p, idents[region.rng.next32() % identCount]});
+            break;
+        }
+    }
+}
+
+static void placeActors(World &w, const std::vector<Placement> &list) {
+    for (const Placement &placement : list) {
+        Actor *actor = w.createActor(w.getActorDef(placement.ident));
+        if (!actor) return;
+        actor->reset();
+        if (!w.moveActor(actor, placement.pos)) {
+            logger_log("Failed to place actor at " + placement.pos.toString() + ".");
+            w.destroyActor(actor);
+        }
+    }
+}
 
 Point findOpenTile(World &w, Random &rng, bool allowActor, bool allowItem) {
     Point p;
@@ -7,171 +145,129 @@ Point findOpenTile(World &w, Random &rng, bool allowActor, bool allowItem) {
         p.x = rng.next32() % w.width();
         p.y = rng.next32() % w.height();
         bool valid = true;
-        const auto &t = w.at(p);
-        if (t.building > 0) valid = false;
-        if (w.getTileDef(t.terrain).solid) valid = false;
-        if (!allowActor && t.actor) continue;
+        if (w.getBuilding(p) > 0) valid = false;
+        if (w.getTileFlags(w.getTerrain(p)) & TF_SOLID) valid = false;
+        if (!allowActor && w.at(p).actor) continue;
         if (valid) break;
     } while (1);
     return p;
 }
 
 
-bool buildmap(World &w, unsigned long seed) {
-    Random rng;
-    rng.seed(seed);
+bool buildmap(World &w, unsigned long seed, unsigned threads) {
+    static const int oreList[] = { 30, 31, 32, 32, 33, 34 };
+    static const int plantList[] = { 1000, 1000, 1001, 1005, 1007, 1009 };
+    static const int npcList[] = { 2, 3, 3, 4, 4, 4, 5, 5, 6, 3, 3, 4, 4, 4, 5, 5, 6, 2000};
 
-    const int mapArea = w.width() * w.height();
-    const int lakeCount = mapArea / 1280;
-    const int mountainCount = mapArea / 640;
-    const int dirtCount = mapArea / 640;
-    const int sandCount = mapArea / 640;
-    const int oreCount = mapArea / 32;
-    const int plantCount = mapArea / 16;
-    const int actorCount = mapArea / 340;
+    WorkerPool pool(threads);
+    MapPlan plan;
+    plan.regionsWide = (w.width() + REGION_SIZE - 1) / REGION_SIZE;
+    plan.regionsHigh = (w.height() + REGION_SIZE - 1) / REGION_SIZE;
+    plan.regions.resize(plan.regionsWide * plan.regionsHigh);
+    plan.topBorder.resize(w.width());
+    plan.bottomBorder.resize(w.width());
+    plan.leftBorder.resize(w.height());
+    plan.rightBorder.resize(w.height());
+    const int regionTotal = plan.regions.size();
 
-    // ensure all ground is grass
-    for (int y = 0; y < w.height(); ++y) {
-        for (int x = 0; x < w.width(); ++x) {
-            w.setTerrain(Point(x, y), TILE_GRASS);
-        }
-    }
+    // pick the location of every feature; border depths are chosen by the
+    // regions along the top and left edges
+    pool.parallelFor(regionTotal, [&](int i) {
+        Region &region = plan.regions[i];
+        int rx = i % plan.regionsWide, ry = i / plan.regionsWide;
+        region.corner = Point(rx * REGION_SIZE, ry * REGION_SIZE);
+        region.width = std::min(REGION_SIZE, w.width() - region.corner.x);
+        region.height = std::min(REGION_SIZE, w.height() - region.corner.y);
+        region.rng.seed(regionSeed(seed, rx, ry));
 
-    // add lakes
-    for (int i = 0; i < lakeCount; ++i) {
-        int radius = rng.between(4, 20);
-        int cx = rng.next32() % w.width();
-        int cy = rng.next32() % w.height();
-        for (int y = cy - radius; y <= cy + radius; ++y) {
-            for (int x = cx - radius; x <= cx + radius; ++x) {
-                int dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
-                if (dist <= radius) {
-                    w.setTerrain(Point(x, y), TILE_WATER);
-                }
+        planFeatures(region, region.lakes,     1280, 4, 20);
+        planFeatures(region, region.mountains, 640,  2, 12);
+        planFeatures(region, region.dirt,      640,  6, 12);
+        planFeatures(region, region.sand,      640,  6, 12);
+        int oreCount = regionCount(region, 32);
+        for (int j = 0; j < oreCount; ++j) {
+            Point p = regionPoint(region);
+            region.ores.push_back(Placement{p, oreList[region.rng.next32() % 6]});
+        }
+        if (ry == 0) {
+            for (int x = region.corner.x; x < region.corner.x + region.width; ++x) {
+                plan.topBorder[x] = region.rng.between(3, 5);
+                plan.bottomBorder[x] = region.rng.between(3, 5);
             }
         }
-    }
-
-    // add mountains
-    for (int i = 0; i < mountainCount; ++i) {
-        int radius = rng.between(2, 12);
-        int cx = rng.next32() % w.width();
-        int cy = rng.next32() % w.height();
-        for (int y = cy - radius; y <= cy + radius; ++y) {
-            for (int x = cx - radius; x <= cx + radius; ++x) {
-                int dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
-                if (dist <= radius) {
-                    w.setTerrain(Point(x, y), TILE_DIRT);
-                    w.setBuilding(Point(x, y), TILE_STONE);
-                }
+        if (rx == 0) {
+            for (int y = region.corner.y; y < region.corner.y + region.height; ++y) {
+                plan.leftBorder[y] = region.rng.between(3, 5);
+                plan.rightBorder[y] = region.rng.between(3, 5);
             }
         }
-    }
+    });
 
+    // ensure all ground is grass
+    pool.parallelFor(regionTotal, [&](int i) {
+        const Region &region = plan.regions[i];
+        w.fillRect(LAYER_TERRAIN, region.corner, region.width, region.height, TILE_GRASS);
+    });
 
-    // add dirt patches
-    for (int i = 0; i < dirtCount; ++i) {
-        int radius = rng.between(6, 12);
-        int cx = rng.next32() % w.width();
-        int cy = rng.next32() % w.height();
-        for (int y = cy - radius; y <= cy + radius; ++y) {
-            for (int x = cx - radius; x <= cx + radius; ++x) {
-                int dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
-                const Tile &tile = w.at(Point(x, y));
-                if (dist <= radius && tile.terrain == 2) {
-                    w.setTerrain(Point(x, y), TILE_DIRT);
-                }
-            }
-        }
-    }
+    // add lakes
+    pool.parallelFor(regionTotal, [&](int i) {
+        paintFeatures(w, plan, i, &Region::lakes, LAYER_TERRAIN, TILE_WATER, -1);
+    });
 
+    // add mountains
+    pool.parallelFor(regionTotal, [&](int i) {
+        paintFeatures(w, plan, i, &Region::mountains, LAYER_TERRAIN, TILE_DIRT, -1);
+        paintFeatures(w, plan, i, &Region::mountains, LAYER_BUILDING, TILE_STONE, -1);
+    });
 
-    // add sand patches
-    for (int i = 0; i < sandCount; ++i) {
-        int radius = rng.between(6, 12);
-        int cx = rng.next32() % w.width();
-        int cy = rng.next32() % w.height();
-        for (int y = cy - radius; y <= cy + radius; ++y) {
-            for (int x = cx - radius; x <= cx + radius; ++x) {
-                int dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
-                const Tile &tile = w.at(Point(x, y));
-                if (dist <= radius && tile.terrain == 2) {
-                    w.setTerrain(Point(x, y), TILE_SAND);
-                }
-            }
-        }
-    }
+    // add dirt patches
+    pool.parallelFor(regionTotal, [&](int i) {
+        paintFeatures(w, plan, i, &Region::dirt, LAYER_TERRAIN, TILE_DIRT, TILE_GRASS);
+    });
 
+    // add sand patches
+    pool.parallelFor(regionTotal, [&](int i) {
+        paintFeatures(w, plan, i, &Region::sand, LAYER_TERRAIN, TILE_SAND, TILE_GRASS);
+    });
 
     // add ore veins
-    std::vector<int> oreList{ 30, 31, 32, 32, 33, 34 };
-    for (int i = 0; i < oreCount; ++i) {
-        int cx = rng.next32() % w.width();
-        int cy = rng.next32() % w.height();
-        Point c(cx, cy);
-        if (w.at(c).building == TILE_STONE) {
-            int oreNum = rng.next32() % oreList.size();
-            w.setBuilding(c, oreList[oreNum]);
+    pool.parallelFor(regionTotal, [&](int i) {
+        for (const Placement &ore : plan.regions[i].ores) {
+            if (w.getBuilding(ore.pos) == TILE_STONE) {
+                w.setRaw(LAYER_BUILDING, ore.pos, ore.ident);
+            }
         }
-    }
+    });
 
     // build map borders
-    for (int x = 0; x < w.width(); ++x) {
-        int size = rng.between(3, 5);
-        for (int y = 0; y < size; ++y) {
-            Point top(x, y);
-            w.setTerrain(top, TILE_OCEAN);
-            w.setBuilding(top, 0);
-            Point bottom(x, w.height() - 1 - y);
-            w.setTerrain(bottom, TILE_OCEAN);
-            w.setBuilding(bottom, 0);
-        }
-    }
-    for (int y = 0; y < w.height(); ++y) {
-        int size = rng.between(3, 5);
-        for (int x = 0; x < size; ++x) {
-            Point left(x, y);
-            w.setTerrain(left, TILE_OCEAN);
-            w.setBuilding(left, 0);
-            Point right(w.width() - 1 - x, y);
-            w.setTerrain(right, TILE_OCEAN);
-            w.setBuilding(right, 0);
-        }
-    }
+    pool.parallelFor(regionTotal, [&](int i) {
+        paintBorders(w, plan, i);
+    });
 
-
-    // add plants
-    int plantList[] = { 1000, 1000, 1001, 1005, 1007, 1009 };
-    for (int i = 0; i < plantCount; ++i) {
-        Point p = findOpenTile(w, rng, false, false);
-        int plantNum = rng.next32() % 6;
-        Actor *actor = new Actor(w.getActorDef(plantList[plantNum]));
-        actor->reset();
-        if (!w.moveActor(actor, p)) {
-            logger_log("Failed to place plant at " + p.toString() + ".");
-            delete actor;
-        }
+    // choose spots for plants and NPCs; the actors themselves are created
+    // afterwards in region order
+    pool.parallelFor(regionTotal, [&](int i) {
+        Region &region = plan.regions[i];
+        std::vector<char> used(region.width * region.height, false);
+        planPlacements(w, region, used, region.plants, 16, plantList, 6);
+        planPlacements(w, region, used, region.npcs, 340, npcList, 18);
+    });
+    for (const Region &region : plan.regions) {
+        placeActors(w, region.plants);
     }
-
-    // add NPCs
-    int npcList[] = { 2, 3, 3, 4, 4, 4, 5, 5, 6, 3, 3, 4, 4, 4, 5, 5, 6, 2000};
-    for (int i = 0; i < actorCount; ++i) {
-        Point p = findOpenTile(w, rng, false, true);
-        int npcNum = rng.next32() % 18;
-        int type = npcList[npcNum];
-        Actor *actor = new Actor(w.getActorDef(type));
-        actor->reset();
-        if (!w.moveActor(actor, p)) {
-            logger_log("Failed to place actor at " + p.toString() + ".");
-            delete actor;
-        }
+    for (const Region &region : plan.regions) {
+        placeActors(w, region.npcs);
     }
 
     // add player
-    Actor *player = new Actor(w.getActorDef(1));
+    Random rng;
+    rng.seed(seed);
+    Actor *player = w.createActor(w.getActorDef(1));
+    if (!player) return false;
     Point starting = findOpenTile(w, rng, false, true);
     player->reset();
     w.moveActor(player, starting);
 
+    w.finishBulkEdit();
     return true;
-}
\ No newline at end of file
+}
@@ -8,7 +8,11 @@ ConfigData configRead(const std::string &filename) {
     std::stringstream filetext(readFile(filename));
 
     ConfigData data = {
-        80, 25 // screen width, height
+        80, 25, // screen width, height
+        0, 1,   // simulation radius, far actor interval (off)
+        1000, 8, REST_ON_HOSTILE | REST_ON_DAMAGE | REST_ON_CROP,
+        true,   // compress saves
+        100     // turns between autosaves
     };
 
     unsigned lineNumber = 0;
@@ -37,6 +41,52 @@ ConfigData configRead(const std::string &filename) {
                 data.screenHeight = 24;
                 logger_log(filename + ":" + std::to_string(lineNumber) + " Screen height must be at least 24.");
             }
+        } else if (field == "simRadius") {
+            if (!strToInt(value, data.simRadius)) logger_log(filename + ":" + std::to_string(lineNumber) + " Simulation radius is not valid number.");
+            if (data.simRadius < 0) {
+                data.simRadius = 0;
+                logger_log(filename + ":" + std::to_string(lineNumber) + " Simulation radius cannot be negative.");
+            }
+        } else if (field == "simFarInterval") {
+            if (!strToInt(value, data.simFarInterval)) logger_log(filename + ":" + std::to_string(lineNumber) + " Far actor interval is not valid number.");
+            if (data.simFarInterval < 1) {
+                data.simFarInterval = 1;
+                logger_log(filename + ":" + std::to_string(lineNumber) + " Far actor interval must be at least 1.");
+            }
+        } else if (field == "restMaxTurns") {
+            if (!strToInt(value, data.restMaxTurns) || data.restMaxTurns < 1) {
+                data.restMaxTurns = 1000;
+                logger_log(filename + ":" + std::to_string(lineNumber) + " Rest length must be a positive number.");
+            }
+        } else if (field == "restRadius") {
+            if (!strToInt(value, data.restRadius) || data.restRadius < 0) {
+                data.restRadius = 8;
+                logger_log(filename + ":" + std::to_string(lineNumber) + " Rest radius must be a number of at least 0.");
+            }
+        } else if (field == "restOnHostile" || field == "restOnDamage" || field == "restOnCrop") {
+            unsigned flag = REST_ON_HOSTILE;
+            if (field == "restOnDamage")    flag = REST_ON_DAMAGE;
+            if (field == "restOnCrop")      flag = REST_ON_CROP;
+            int enabled = 0;
+            if (!strToInt(value, enabled)) {
+                logger_log(filename + ":" + std::to_string(lineNumber) + " " + field + " must be 0 or 1.");
+            } else if (enabled) {
+                data.restStopOn |= flag;
+            } else {
+                data.restStopOn &= ~flag;
+            }
+        } else if (field == "compressSaves") {
+            int enabled = 0;
+            if (!strToInt(value, enabled)) {
+                logger_log(filename + ":" + std::to_string(lineNumber) + " compressSaves must be 0 or 1.");
+            } else {
+                data.compressSaves = enabled != 0;
+            }
+        } else if (field == "autosaveTurns") {
+            if (!strToInt(value, data.autosaveTurns) || data.autosaveTurns < 0) {
+                data.autosaveTurns = 100;
+                logger_log(filename + ":" + std::to_string(lineNumber) + " autosaveTurns must be 0 or more.");
+            }
         } else {
             logger_log(filename + ":" + std::to_string(lineNumber) + " Unknown config value " + field + ".");
         }
@@ -26,6 +26,8 @@ int maxCraftable(World &w, const RecipeDef *recipe, const Inventory &inventory)
 }
 
 void doCrafting(World &w, Actor *player, unsigned craftingStation) {
+    // recipes are picked from a menu the journal does not see
+    w.markJournalGap();
     const unsigned highlightBG  = 0xFF666666;
     const unsigned highlightFG  = 0xFFFFFFFF;
     const unsigned textBG       = 0xFF000000;
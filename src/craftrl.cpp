@@ -10,8 +10,7 @@ Dir getDir(World &w, const std::string &reason);
 void redraw_main(World &w);
 
 
-Dir getDir(World &w, const std::string &reason) {
-    w.addLogMsg(reason + ". Which way? (Z to cancel)");
+static Dir readDir(World &w) {
     redraw_main(w);
     terminal_refresh();
     while (1) {
@@ -28,6 +27,16 @@ Dir getDir(World &w, const std::string &reason) {
     }
 }
 
+Dir getDir(World &w, const std::string &reason) {
+    w.addLogMsg(reason + ". Which way? (Z to cancel)");
+    Dir dir;
+    // a replayed command gets the answer it was given at the time
+    if (w.replayAnswer(dir)) return dir;
+    dir = readDir(w);
+    w.journalAnswer(dir);
+    return dir;
+}
+
 
 void viewLog(World &w) {
     const int screenHeight = 24;
@@ -109,8 +118,8 @@ void redraw_main(World &w) {
                 int variant = w.getTileVariant(here);
                 terminal_put(x * 2, y, w.getTileDef(tile.building).glyph + variant);
             }
-            if (tile.item) {
-                terminal_put(x * 2, y, tile.item->def.glyph);
+            if (!tile.item.empty()) {
+                terminal_put(x * 2, y, w.getItemDef(tile.item.ident).glyph);
             }
             if (tile.actor) {
                 terminal_put(x * 2, y, tile.actor->def.glyph);
@@ -152,6 +161,19 @@ void redraw_main(World &w) {
     terminal_printf(screenWidth - 15, logY + 1, " Draw: %u ", w.renderTime);
 }
 
+// Commands that only move the view or save are left out of the journal.
+static bool journaled(int command) {
+    switch (command) {
+        case CMD_PAN:
+        case CMD_RESETVIEW:
+        case CMD_VIEWLOG:
+        case CMD_SAVE:
+        case CMD_QUIT:
+            return false;
+        default:
+            return true;
+    }
+}
 
 void gameloop(World &w) {
     w.mode = w.selection = 0;
@@ -165,12 +187,18 @@ void gameloop(World &w) {
 
 
     bool wantTick = false;
+    unsigned lastAutosave = w.getTurn();
+    unsigned lastFlush = w.getTurn();
     while (!w.wantsToQuit) {
         redraw_main(w);
         terminal_refresh();
         int key = terminal_read();
+        bool journal = false;
+        JournalEntry entry;
 
         if (key == TK_P) {
+            // the same as sorting by name, which is how it is journaled
+            w.journalCommand(w.startJournalEntry(Command{ CMD_SORT_INV_NAME }));
             player->inventory.sort(SORT_NAME);
         }
 
@@ -187,15 +215,15 @@ void gameloop(World &w) {
                 if (tile.building) {
                     s << ", " << w.getTileDef(tile.building).name;
                 }
-                if (tile.item) {
-                    s << ", " << tile.item->getName(false);
+                if (!tile.item.empty()) {
+                    s << ", " << itemStackName(w.getItemDef(tile.item.ident), tile.item.qty);
                 }
                 if (tile.actor) {
                     s << ", " << tile.actor->getName();
                 }
                 if (tile.room) {
                     s << " in " << tile.room->def->name << "(";
-                    s << "size:" << tile.room->points.size() << ')';
+                    s << "size:" << tile.room->tiles.size() << ')';
                 }
                 w.addLogMsg(s.str());
             }
@@ -204,7 +232,11 @@ void gameloop(World &w) {
             const Command &command = findCommand(key, gameCommands);
             ActionHandler handler = commandAction(command.command);
             if (handler) {
+                journal = journaled(command.command);
+                entry = w.startJournalEntry(command);
+                w.beginBatch();
                 wantTick = handler(w, player, command, false);
+                w.endBatch();
             }
         }
 
@@ -212,7 +244,29 @@ void gameloop(World &w) {
             w.tick();
             wantTick = false;
         }
+
+        if (w.takeJournalGap()) {
+            // the command read input the journal can't hold, so save instead
+            w.finishAutosave(true);
+            w.autosave("game.sav");
+            lastAutosave = w.getTurn();
+        } else if (journal) {
+            w.journalCommand(entry);
+        }
+        // entries go to disk a turn at a time
+        if (w.getTurn() != lastFlush) {
+            w.flushJournal();
+            lastFlush = w.getTurn();
+        }
+
+        w.finishAutosave(false);
+        const int autosaveTurns = w.configData.autosaveTurns;
+        if (autosaveTurns > 0 && w.getTurn() - lastAutosave >= static_cast<unsigned>(autosaveTurns)) {
+            w.autosave("game.sav");
+            lastAutosave = w.getTurn();
+        }
     }
+    w.flushJournal();
 }
 
 
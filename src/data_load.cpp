@@ -1,9 +1,15 @@
+#include <limits>
 #include <map>
 #include "data.h"
 #include "world.h"
 
 LootTable* parseLootTable(World &w, TokenData &data);
 
+// Tile and item idents are stored as shorts on the map.
+static bool fitsMap(int ident) {
+    return ident >= std::numeric_limits<short>::min() && ident <= std::numeric_limits<short>::max();
+}
+
 bool parseAddfile(World &w, TokenData &data) {
     data.next(); // skip "addfile"
 
@@ -201,6 +207,10 @@ bool parseItem(World &w, TokenData &data) {
     data.next(); // skip "}"
     if (!data.require(TokenType::Semicolon)) return false;
     data.next(); // skip ";"
+    if (!fitsMap(item.ident)) {
+            logger_log(fullOrigin.toString() + "  item ident " + std::to_string(item.ident) + " out of range.");
+            return false;
+    }
     if (w.getItemDef(item.ident).ident >= 0) {
             logger_log(fullOrigin.toString() + "  item ident " + std::to_string(item.ident) + " already used.");
             return false;
@@ -424,6 +434,10 @@ bool parseTile(World &w, TokenData &data) {
     data.next(); // skip "}"
     if (!data.require(TokenType::Semicolon)) return false;
     data.next(); // skip ";"
+    if (!fitsMap(tile.ident)) {
+            logger_log(fullOrigin.toString() + "  tile ident " + std::to_string(tile.ident) + " out of range.");
+            return false;
+    }
     if (w.getTileDef(tile.ident).ident >= 0) {
             logger_log(fullOrigin.toString() + "  tile ident " + std::to_string(tile.ident) + " already used.");
             return false;
@@ -441,6 +455,7 @@ bool loadGameData(World &w, const std::string &filename) {
     for (unsigned i = 0; i < data.fileList.size(); ++i) {
         errorCount += loadGameData_Core(w, data, data.fileList[i]);
     }
+    w.indexDefs();
 
     logger_log("Loaded " + std::to_string(w.actorDefCount()) + " actors.");
     logger_log("Loaded "   + std::to_string(w.itemDefCount()) + " items.");
@@ -54,6 +54,7 @@ DebugCommand debugCommands[] = {
 };
 
 void doDebug(World &w, Actor *player) {
+    w.markJournalGap();
     std::string fullCommand;
     if (!ui_prompt("Debug", "Enter Command", fullCommand)) {
         return;
@@ -138,7 +139,7 @@ void debugInfo(World &w, Actor *player, const std::vector<std::string> &command)
 
     Actor *a = tile.actor;
     std::stringstream s;
-    s << a->getName() << ": H" << a->health << '/' << a->def.health << " F" << a->faction << " A" << a->age << " T" << a->type << " INV" << a->inventory.size();
+    s << a->getName() << ": H" << a->health << '/' << a->def.health << " F" << a->faction << " A" << w.getActorAge(a) << " T" << a->type << " INV" << a->inventory.size();
     w.addLogMsg(s.str());
 }
 
@@ -160,7 +161,7 @@ void debugKill(World &w, Actor *player, const std::vector<std::string> &command)
                 w.addLogMsg("Killed " + tile.actor->getName() + ".");
                 tile.actor->health = 0;
                 makeLootAt(w, tile.actor->def.loot, tile.actor->pos, true);
-                w.moveActor(tile.actor, Point(0, 0));
+                w.removeActor(tile.actor);
             }
         }
     }
@@ -201,7 +202,11 @@ void debugSpawn(World &w, Actor *player, const std::vector<std::string> &command
         return;
     }
 
-    Actor *actor = new Actor(def);
+    Actor *actor = w.createActor(def);
+    if (!actor) {
+        w.addLogMsg("Too many actors.");
+        return;
+    }
     actor->reset();
     w.moveActor(actor, p);
     w.addLogMsg("Spawned " + def.name + " at " + p.toString() + ".");
@@ -16,6 +16,7 @@ const Command gameCommands[] = {
     {   CMD_TALK,           Dir::None,      { { TK_T,        },  } },
     {   CMD_USE,            Dir::None,      { { TK_ENTER,    }, { TK_KP_ENTER} } },
     {   CMD_WAIT,           Dir::None,      { { TK_SPACE     }, { TK_KP_5 } } },
+    {   CMD_REST,           Dir::None,      { { TK_W,        },  } },
     {   CMD_CRAFT,          Dir::None,      { { TK_C,        },  } },
     {   CMD_SAVE,           Dir::None,      { { TK_F2,       },  } },
     {   CMD_PREV_SELECT,    Dir::None,      { { TK_LBRACKET, }, { TK_KP_MINUS } } },
@@ -75,6 +76,7 @@ std::string commandName(int command) {
         case CMD_DROP:          return "Drop";
         case CMD_USE:           return "Use";
         case CMD_WAIT:          return "Wait";
+        case CMD_REST:          return "Rest";
         case CMD_TALK:          return "Talk";
         case CMD_CONTEXTMOVE:   return "Context-Sensitive Move";
         case CMD_QUIT:          return "Quit";
@@ -111,6 +113,7 @@ ActionHandler commandAction(int command) {
         case CMD_DROP:          return actionDrop;
         case CMD_USE:           return actionUse;
         case CMD_WAIT:          return actionWait;
+        case CMD_REST:          return actionRest;
         case CMD_TALK:          return actionTalkActor;
         case CMD_CONTEXTMOVE:   return actionContextMove;
         case CMD_QUIT:          return actionQuit;
@@ -0,0 +1,91 @@
+#include "journal.h"
+#include "world.h"
+
+JournalWriter::JournalWriter()
+: mBusy(false), mStopping(false), mFailed(false)
+{ }
+
+JournalWriter::~JournalWriter() {
+    if (!mThread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mThread.join();
+}
+
+void JournalWriter::restart(const std::string &filename, const SaveWriter &data) {
+    push(filename, data, true);
+}
+
+void JournalWriter::append(const std::string &filename, const SaveWriter &data) {
+    push(filename, data, false);
+}
+
+void JournalWriter::push(const std::string &filename, const SaveWriter &data, bool replace) {
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mJobs.push_back(Job{filename, data, replace});
+        // started on first use, as most worlds never journal anything
+        if (!mThread.joinable()) mThread = std::thread(&JournalWriter::writerMain, this);
+    }
+    mWake.notify_one();
+}
+
+void JournalWriter::wait() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mDone.wait(lock, [this]() { return mJobs.empty() && !mBusy; });
+}
+
+bool JournalWriter::takeFailure() {
+    std::lock_guard<std::mutex> guard(mLock);
+    bool failed = mFailed;
+    mFailed = false;
+    return failed;
+}
+
+void JournalWriter::writerMain() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (1) {
+        mWake.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+        if (mJobs.empty()) return;
+        Job job = std::move(mJobs.front());
+        mJobs.pop_front();
+        mBusy = true;
+        lock.unlock();
+        bool written = job.replace ? job.data.writeFile(job.filename) : job.data.appendFile(job.filename);
+        lock.lock();
+        mBusy = false;
+        if (!written) mFailed = true;
+        mDone.notify_all();
+    }
+}
+
+bool replayJournal(World &w, const std::string &filename, ActionHandler (*actionFor)(int)) {
+    std::vector<JournalEntry> entries;
+    if (!w.readJournal(entries)) return true;
+    unsigned replayed = 0;
+    for (const JournalEntry &entry : entries) {
+        Actor *player = w.getPlayer();
+        ActionHandler handler = actionFor(entry.command);
+        if (!player || !handler || entry.turn != w.getTurn()) break;
+        const Command command = { entry.command, entry.dir };
+        w.beginReplay(entry);
+        w.beginBatch();
+        bool wantTick = handler(w, player, command, false);
+        w.endBatch();
+        if (wantTick) w.tick();
+        w.endReplay();
+        ++replayed;
+    }
+    logger_log("replayJournal (info): replayed " + std::to_string(replayed) + " of "
+               + std::to_string(entries.size()) + " journaled commands.");
+    if (replayed < entries.size()) {
+        w.addLogMsg("Only part of the journal could be replayed.");
+        w.savegame(filename);
+        return false;
+    }
+    w.addLogMsg("Replayed " + std::to_string(replayed) + " commands from the journal.");
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "save_buffer.h"
+
+// Writes the command journal on a thread of its own, so the game hands over
+// each batch and carries on. Writes reach the file in the order given.
+class JournalWriter {
+public:
+    JournalWriter();
+    // finishes any writes still waiting
+    ~JournalWriter();
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    // Replaces filename, in the PhysFS write directory, with data.
+    void restart(const std::string &filename, const SaveWriter &data);
+    void append(const std::string &filename, const SaveWriter &data);
+    // Returns once everything handed over so far has been written.
+    void wait();
+    // true if a write failed since the last call
+    bool takeFailure();
+
+private:
+    struct Job {
+        std::string filename;
+        SaveWriter data;
+        bool replace;
+    };
+    void push(const std::string &filename, const SaveWriter &data, bool replace);
+    void writerMain();
+
+    std::thread mThread;
+    std::mutex mLock;
+    std::condition_variable mWake, mDone;
+    std::deque<Job> mJobs;
+    bool mBusy, mStopping, mFailed;
+};
+
+#endif
@@ -10,6 +10,15 @@
 
 #include <cstdint>
 
+// Scrambles a 64-bit value (the SplitMix64 finaliser). Used to derive
+// independent, reproducible seeds from a base seed and a counter.
+inline std::uint64_t mixSeed(std::uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
 class Random {
 public:
     Random()
@@ -21,6 +30,16 @@ public:
         v2 = seed >> 2;
     }
 
+    // The whole state, so a game can be put back exactly as it was.
+    void getState(std::uint64_t &state1, std::uint64_t &state2) const {
+        state1 = v1;
+        state2 = v2;
+    }
+    void setState(std::uint64_t state1, std::uint64_t state2) {
+        v1 = state1;
+        v2 = state2;
+    }
+
     uint64_t next64() {
         uint64_t t1, t2, result;
         t1 = v2;
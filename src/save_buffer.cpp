@@ -0,0 +1,396 @@
+#include <cstring>
+#include <utility>
+#include <physfs.h>
+#include "lodepng.h"
+#include "save_buffer.h"
+
+// saves in a plain directory are mapped rather than read where mmap exists
+#if defined(__linux__) || defined(__APPLE__)
+#define SAVE_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static bool hostIsLittleEndian() {
+    const unsigned one = 1;
+    return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+void SaveWriter::write16(unsigned short value) {
+    mData.push_back(value);
+    mData.push_back(value >> 8);
+}
+
+void SaveWriter::write32(unsigned value) {
+    mData.push_back(value);
+    mData.push_back(value >> 8);
+    mData.push_back(value >> 16);
+    mData.push_back(value >> 24);
+}
+
+void SaveWriter::write64(unsigned long long value) {
+    write32(value);
+    write32(value >> 32);
+}
+
+void SaveWriter::writeString(const std::string &s) {
+    mData.insert(mData.end(), s.begin(), s.end());
+    mData.push_back(0);
+}
+
+void SaveWriter::writeBytes(const unsigned char *bytes, std::size_t count) {
+    mData.insert(mData.end(), bytes, bytes + count);
+}
+
+void SaveWriter::write16s(const short *values, unsigned count) {
+    if (count == 0) return;
+    unsigned start = mData.size();
+    mData.resize(start + count * 2);
+    unsigned char *out = &mData[start];
+    if (hostIsLittleEndian()) {
+        std::memcpy(out, values, count * 2);
+        return;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned short v = values[i];
+        out[i * 2]     = v;
+        out[i * 2 + 1] = v >> 8;
+    }
+}
+
+void SaveWriter::write32s(const unsigned *values, unsigned count) {
+    if (count == 0) return;
+    unsigned start = mData.size();
+    mData.resize(start + count * 4);
+    unsigned char *out = &mData[start];
+    if (hostIsLittleEndian()) {
+        std::memcpy(out, values, count * 4);
+        return;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        out[i * 4]     = values[i];
+        out[i * 4 + 1] = values[i] >> 8;
+        out[i * 4 + 2] = values[i] >> 16;
+        out[i * 4 + 3] = values[i] >> 24;
+    }
+}
+
+void SaveWriter::writeRuns16(const short *values, unsigned count) {
+    unsigned i = 0;
+    while (i < count) {
+        unsigned run = 1;
+        while (i + run < count && run < 0xFFFF && values[i + run] == values[i]) ++run;
+        write16(run);
+        write16(values[i]);
+        i += run;
+    }
+}
+
+void SaveWriter::patch32(unsigned offset, unsigned value) {
+    mData[offset]     = value;
+    mData[offset + 1] = value >> 8;
+    mData[offset + 2] = value >> 16;
+    mData[offset + 3] = value >> 24;
+}
+
+static bool writeAll(PHYSFS_File *out, const std::vector<unsigned char> &data) {
+    if (!out) return false;
+    bool written = data.empty()
+        || PHYSFS_writeBytes(out, data.data(), data.size()) == static_cast<PHYSFS_sint64>(data.size());
+    return PHYSFS_close(out) && written;
+}
+
+bool SaveWriter::writeFile(const std::string &filename) const {
+    return writeAll(PHYSFS_openWrite(filename.c_str()), mData);
+}
+
+bool SaveWriter::appendFile(const std::string &filename) const {
+    return writeAll(PHYSFS_openAppend(filename.c_str()), mData);
+}
+
+
+SaveReader::SaveReader()
+: mMapping(nullptr), mMappingSize(0), mBegin(nullptr), mEnd(nullptr), mPos(nullptr), mFailed(false)
+{ }
+
+SaveReader::SaveReader(const unsigned char *data, std::size_t size)
+: mMapping(nullptr), mMappingSize(0), mBegin(data), mEnd(data + size), mPos(data), mFailed(false)
+{ }
+
+SaveReader::SaveReader(std::vector<unsigned char> &&data)
+: mData(std::move(data)), mMapping(nullptr), mMappingSize(0), mFailed(false)
+{
+    mBegin = mPos = mData.data();
+    mEnd = mBegin + mData.size();
+}
+
+SaveReader::SaveReader(SaveReader &&rhs)
+: mData(std::move(rhs.mData)), mMapping(rhs.mMapping), mMappingSize(rhs.mMappingSize),
+  mBegin(rhs.mBegin), mEnd(rhs.mEnd), mPos(rhs.mPos), mFailed(rhs.mFailed)
+{
+    rhs.mMapping = nullptr;
+    rhs.mMappingSize = 0;
+    rhs.mBegin = rhs.mEnd = rhs.mPos = nullptr;
+}
+
+SaveReader& SaveReader::operator=(SaveReader &&rhs) {
+    if (this == &rhs) return *this;
+    unmap();
+    mData = std::move(rhs.mData);
+    mMapping = rhs.mMapping;
+    mMappingSize = rhs.mMappingSize;
+    mBegin = rhs.mBegin;
+    mEnd = rhs.mEnd;
+    mPos = rhs.mPos;
+    mFailed = rhs.mFailed;
+    rhs.mMapping = nullptr;
+    rhs.mMappingSize = 0;
+    rhs.mBegin = rhs.mEnd = rhs.mPos = nullptr;
+    return *this;
+}
+
+SaveReader::~SaveReader() {
+    unmap();
+}
+
+void SaveReader::unmap() {
+#ifdef SAVE_USE_MMAP
+    if (mMapping) munmap(mMapping, mMappingSize);
+#endif
+    mMapping = nullptr;
+    mMappingSize = 0;
+}
+
+bool SaveReader::readFile(const std::string &filename) {
+    *this = SaveReader();
+    if (mapFile(filename)) return true;
+
+    PHYSFS_File *inf = PHYSFS_openRead(filename.c_str());
+    if (!inf) return false;
+    PHYSFS_sint64 length = PHYSFS_fileLength(inf);
+    std::vector<unsigned char> data;
+    bool good = length >= 0;
+    if (good) {
+        data.resize(length);
+        good = length == 0 || PHYSFS_readBytes(inf, data.data(), length) == length;
+    }
+    PHYSFS_close(inf);
+    if (good) *this = SaveReader(std::move(data));
+    return good;
+}
+
+// Maps filename if PhysFS finds it in a directory mounted from the native
+// filesystem. Returns false, leaving the reader empty, if it cannot.
+bool SaveReader::mapFile(const std::string &filename) {
+#ifdef SAVE_USE_MMAP
+    const char *realDir = PHYSFS_getRealDir(filename.c_str());
+    if (!realDir) return false;
+    struct stat info;
+    if (stat(realDir, &info) != 0 || !S_ISDIR(info.st_mode)) return false;
+
+    // turn the PhysFS path into one under the directory it was mounted from
+    const char *mounted = PHYSFS_getMountPoint(realDir);
+    std::string mountPoint = mounted ? mounted : "/";
+    if (mountPoint.empty() || mountPoint.back() != '/') mountPoint += '/';
+    std::string path = filename;
+    if (path.empty() || path[0] != '/') path = '/' + path;
+    if (path.compare(0, mountPoint.size(), mountPoint) != 0) return false;
+    const std::string nativePath = std::string(realDir) + "/" + path.substr(mountPoint.size());
+
+    int fd = open(nativePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    mMapping = mapping;
+    mMappingSize = info.st_size;
+    mBegin = mPos = static_cast<const unsigned char*>(mapping);
+    mEnd = mBegin + mMappingSize;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SaveReader::take(std::size_t bytes) {
+    if (mFailed || bytes > remaining()) {
+        mFailed = true;
+        return false;
+    }
+    return true;
+}
+
+int SaveReader::read8() {
+    if (!take(1)) return -1;
+    return *mPos++;
+}
+
+int SaveReader::read16() {
+    if (!take(2)) return -1;
+    const unsigned char *in = mPos;
+    mPos += 2;
+    return in[0] | (in[1] << 8);
+}
+
+int SaveReader::read32() {
+    if (!take(4)) return -1;
+    const unsigned char *in = mPos;
+    mPos += 4;
+    return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<unsigned>(in[3]) << 24);
+}
+
+unsigned long long SaveReader::read64() {
+    unsigned long long low = static_cast<unsigned>(read32());
+    unsigned long long high = static_cast<unsigned>(read32());
+    return low | (high << 32);
+}
+
+std::string SaveReader::readString() {
+    if (!take(1)) return std::string();
+    const char *start = reinterpret_cast<const char*>(mPos);
+    const void *end = std::memchr(start, 0, remaining());
+    if (!end) {
+        mFailed = true;
+        return std::string();
+    }
+    std::string s(start, static_cast<const char*>(end));
+    mPos += s.size() + 1;
+    return s;
+}
+
+bool SaveReader::read16s(short *values, unsigned count) {
+    if (count == 0) return !mFailed;
+    if (!take(static_cast<std::size_t>(count) * 2)) {
+        std::memset(values, 0, count * sizeof(short));
+        return false;
+    }
+    const unsigned char *in = mPos;
+    mPos += count * 2;
+    if (hostIsLittleEndian()) {
+        std::memcpy(values, in, count * 2);
+        return true;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        values[i] = static_cast<short>(in[i * 2] | (in[i * 2 + 1] << 8));
+    }
+    return true;
+}
+
+bool SaveReader::readRuns16(short *values, unsigned count) {
+    unsigned filled = 0;
+    while (filled < count) {
+        int run = read16();
+        short value = read16();
+        if (mFailed || run <= 0 || static_cast<unsigned>(run) > count - filled) {
+            mFailed = true;
+            std::memset(values + filled, 0, (count - filled) * sizeof(short));
+            return false;
+        }
+        for (int i = 0; i < run; ++i) values[filled++] = value;
+    }
+    return true;
+}
+
+
+// Deflate settings for saves. The actor section is long and repetitive, and
+// lodepng's defaults spend about three times as long on it for 7% less.
+static LodePNGCompressSettings saveCompressSettings() {
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.windowsize = 1024;
+    settings.nicematch = 32;
+    settings.lazymatching = 0;
+    return settings;
+}
+
+void writeSections(SaveWriter &out, std::vector<SaveSection> &sections, bool compress) {
+    static const LodePNGCompressSettings settings = saveCompressSettings();
+    std::vector<unsigned> rawSizes;
+    std::vector<unsigned char> packed;
+    for (SaveSection &section : sections) {
+        std::vector<unsigned char> &raw = section.data.data();
+        rawSizes.push_back(raw.size());
+        if (compress && !raw.empty() && lodepng::compress(packed, raw, settings) == 0 && packed.size() < raw.size()) {
+            raw.swap(packed);
+            section.encoding |= SECTION_DEFLATE;
+        }
+        packed.clear();
+    }
+
+    const unsigned entrySize = 5 * 4;
+    unsigned offset = out.size() + 4 + sections.size() * entrySize;
+    out.write32(sections.size());
+    for (unsigned i = 0; i < sections.size(); ++i) {
+        out.write32(sections[i].tag);
+        out.write32(sections[i].encoding);
+        out.write32(offset);
+        out.write32(sections[i].data.size());
+        out.write32(rawSizes[i]);
+        offset += sections[i].data.size();
+    }
+    for (const SaveSection &section : sections) {
+        out.writeBytes(section.data.data().data(), section.data.size());
+    }
+}
+
+bool PendingSave::write() {
+    writeSections(out, sections, compress);
+    sections.clear();
+    // change records start with their tag and the size of the rest
+    if (append) out.patch32(4, out.size() - 8);
+    return append ? out.appendFile(filename) : out.writeFile(filename);
+}
+
+bool readSectionTable(SaveReader &file, std::vector<SaveSectionEntry> &table) {
+    table.clear();
+    const int count = file.read32();
+    const std::size_t entrySize = 5 * 4;
+    if (file.failed() || count < 0 || static_cast<std::size_t>(count) * entrySize > file.remaining()) {
+        return false;
+    }
+    const std::size_t tableEnd = file.size() - file.remaining() + count * entrySize;
+    for (int i = 0; i < count; ++i) {
+        SaveSectionEntry entry;
+        entry.tag        = file.read32();
+        entry.encoding   = file.read32();
+        entry.offset     = file.read32();
+        entry.storedSize = file.read32();
+        entry.rawSize    = file.read32();
+        if (entry.offset < tableEnd || entry.offset > file.size()
+                || entry.storedSize > file.size() - entry.offset) {
+            return false;
+        }
+        if (!(entry.encoding & SECTION_DEFLATE) && entry.storedSize != entry.rawSize) {
+            return false;
+        }
+        table.push_back(entry);
+    }
+    return !file.failed();
+}
+
+bool openSection(const SaveReader &file, const std::vector<SaveSectionEntry> &table,
+                 unsigned tag, SaveReader &section, unsigned *encoding) {
+    for (const SaveSectionEntry &entry : table) {
+        if (entry.tag != tag) continue;
+        if (encoding) *encoding = entry.encoding;
+        const unsigned char *stored = file.data() + entry.offset;
+        if (!(entry.encoding & SECTION_DEFLATE)) {
+            section = SaveReader(stored, entry.storedSize);
+            return true;
+        }
+        std::vector<unsigned char> raw;
+        raw.reserve(entry.rawSize);
+        if (lodepng::decompress(raw, stored, entry.storedSize) != 0 || raw.size() != entry.rawSize) {
+            return false;
+        }
+        section = SaveReader(std::move(raw));
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,126 @@
+#ifndef SAVE_BUFFER_H
+#define SAVE_BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Bits of a save section's encoding.
+const unsigned SECTION_RUNS     = 1;    // 16-bit values stored as (count, value) runs
+const unsigned SECTION_DEFLATE  = 2;    // payload is zlib compressed
+
+// Builds a save file in memory as little-endian values so it reaches the disk
+// in one large write instead of one PhysFS call per field.
+class SaveWriter {
+public:
+    void write8(unsigned char value) { mData.push_back(value); }
+    void write16(unsigned short value);
+    void write32(unsigned value);
+    void write64(unsigned long long value);
+    void writeString(const std::string &s);
+    void writeBytes(const unsigned char *bytes, std::size_t count);
+    // Bulk writes of whole arrays, converted to little-endian in one pass.
+    void write16s(const short *values, unsigned count);
+    void write32s(const unsigned *values, unsigned count);
+    // Writes values as runs of equal values; see SaveReader::readRuns16.
+    void writeRuns16(const short *values, unsigned count);
+    // Overwrites a value written earlier, such as a count not known up front.
+    void patch32(unsigned offset, unsigned value);
+
+    unsigned size() const { return mData.size(); }
+    const std::vector<unsigned char>& data() const { return mData; }
+    std::vector<unsigned char>& data() { return mData; }
+    // Writes everything to filename in the PhysFS write directory, either
+    // replacing it or adding to the end.
+    bool writeFile(const std::string &filename) const;
+    bool appendFile(const std::string &filename) const;
+
+private:
+    std::vector<unsigned char> mData;
+};
+
+// Reads values back out of a save file held in memory. Reading past the end
+// marks the reader as failed and yields -1 (or zeroes for bulk reads), so a
+// loader can check failed() once per section rather than after every value.
+class SaveReader {
+public:
+    SaveReader();
+    // Reads from memory owned by someone else, which must outlive the reader.
+    SaveReader(const unsigned char *data, std::size_t size);
+    explicit SaveReader(std::vector<unsigned char> &&data);
+    SaveReader(SaveReader &&rhs);
+    SaveReader& operator=(SaveReader &&rhs);
+    SaveReader(const SaveReader&) = delete;
+    SaveReader& operator=(const SaveReader&) = delete;
+    ~SaveReader();
+
+    // Opens filename, a path in the PhysFS search path. Files in a plain
+    // directory are mapped read-only where the platform allows; anything
+    // else, such as a file inside an archive, is read through PhysFS.
+    bool readFile(const std::string &filename);
+    bool mapped() const { return mMapping != nullptr; }
+
+    int read8();
+    int read16();
+    int read32();
+    unsigned long long read64();
+    std::string readString();
+    bool read16s(short *values, unsigned count);
+    bool readRuns16(short *values, unsigned count);
+
+    const unsigned char* data() const { return mBegin; }
+    std::size_t size() const { return mEnd - mBegin; }
+    bool failed() const { return mFailed; }
+    std::size_t remaining() const { return mEnd - mPos; }
+
+private:
+    bool take(std::size_t bytes);
+    bool mapFile(const std::string &filename);
+    void unmap();
+
+    std::vector<unsigned char> mData;
+    void *mMapping;
+    std::size_t mMappingSize;
+    const unsigned char *mBegin, *mEnd, *mPos;
+    bool mFailed;
+};
+
+// A save file is a header followed by a table of sections, each of which
+// is found by its tag and may be stored compressed.
+struct SaveSection {
+    unsigned tag, encoding;
+    SaveWriter data;
+};
+struct SaveSectionEntry {
+    unsigned tag, encoding;
+    unsigned offset, storedSize, rawSize;
+};
+
+// Appends the section table and every section to out, deflating sections
+// when compress is set and it makes them smaller.
+void writeSections(SaveWriter &out, std::vector<SaveSection> &sections, bool compress);
+// Reads the table written by writeSections and checks every section lies
+// within the file after it.
+bool readSectionTable(SaveReader &file, std::vector<SaveSectionEntry> &table);
+// Finds the section with tag and sets section up to read it, inflating it
+// if need be. Returns false if it is missing or will not decompress.
+bool openSection(const SaveReader &file, const std::vector<SaveSectionEntry> &table,
+                 unsigned tag, SaveReader &section, unsigned *encoding = nullptr);
+
+// A save built in memory and waiting to be compressed and written. Writing
+// it touches nothing but the save itself, so it can be done on another
+// thread while the game goes on.
+struct PendingSave {
+    std::string filename;
+    SaveWriter out;
+    std::vector<SaveSection> sections;
+    bool compress, append;
+    // set by whoever calls write
+    bool written;
+
+    // Puts the sections after the header in out, then writes the file or
+    // appends to it.
+    bool write();
+};
+
+#endif
@@ -0,0 +1,114 @@
+// Headless simulation runner. Builds or loads a world, runs it for a number
+// of turns and reports how long that took; nothing here touches the UI.
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <physfs.h>
+
+#include "world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+static double msSince(std::chrono::high_resolution_clock::time_point start) {
+    auto now = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+static void usage() {
+    std::cerr << "usage: craftrl-sim [-size N] [-seed N] [-ticks N] [-threads N] [-simradius N] [-simfar N] [-load FILE] [-save FILE]\n";
+}
+
+int main(int argc, char *argv[]) {
+    int size = 256;
+    int seed = 1;
+    int ticks = 100;
+    int threads = 0;
+    int simRadius = 0, simFar = 1;
+    std::string loadFile, saveFile;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        bool valid = true;
+        if      (arg == "-size")    valid = strToInt(value, size) && size > 0;
+        else if (arg == "-seed")    valid = strToInt(value, seed);
+        else if (arg == "-ticks")   valid = strToInt(value, ticks) && ticks >= 0;
+        else if (arg == "-threads") valid = strToInt(value, threads) && threads >= 0;
+        else if (arg == "-simradius") valid = strToInt(value, simRadius) && simRadius >= 0;
+        else if (arg == "-simfar")  valid = strToInt(value, simFar) && simFar >= 1;
+        else if (arg == "-load")    loadFile = value;
+        else if (arg == "-save")    saveFile = value;
+        else                        valid = false;
+        if (!valid) {
+            usage();
+            return 1;
+        }
+    }
+
+    if (!PHYSFS_init(argv[0])) {
+        std::cerr << "Failed to initialize PhysicsFS: " << PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()) << ".\n";
+        return 1;
+    }
+    const char *baseDir = PHYSFS_getBaseDir();
+    const char *prefDir = PHYSFS_getPrefDir("grendrake", "craftrl");
+    if (!baseDir || !prefDir || !PHYSFS_setWriteDir(prefDir)) {
+        std::cerr << "Failed to set up directories: " << PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()) << ".\n";
+        PHYSFS_deinit();
+        return 1;
+    }
+    PHYSFS_mount(baseDir, "/", true);
+    PHYSFS_mount(prefDir, "/save", false);
+
+    logger_setFile("sim.log");
+    World w;
+    w.getRandom().seed(seed);
+    if (!loadGameData(w, "game.dat")) {
+        std::cerr << "Failed to load game data.\n";
+        return 1;
+    }
+    w.selection = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!loadFile.empty()) {
+        if (!w.loadgame(loadFile)) {
+            std::cerr << "Failed to load " << loadFile << ".\n";
+            return 1;
+        }
+        std::cout << "loaded " << loadFile;
+    } else {
+        w.allocMap(size, size);
+        buildmap(w, seed, threads);
+        std::cout << "generated seed " << seed;
+    }
+    std::cout << " (" << w.width() << "x" << w.height() << ") in " << msSince(start) << " ms\n";
+
+    w.setTickThreads(threads);
+    w.setSimulationLod(simRadius, simFar);
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < ticks; ++i) {
+        w.tick();
+    }
+    double tickTime = msSince(start);
+    std::cout << "ran " << ticks << " ticks in " << tickTime << " ms";
+    if (ticks > 0) std::cout << " (" << tickTime / ticks << " ms/tick)";
+    std::cout << '\n';
+
+    if (!saveFile.empty()) {
+        start = std::chrono::high_resolution_clock::now();
+        if (!w.savegame(saveFile)) {
+            std::cerr << "Failed to save " << saveFile << ".\n";
+            return 1;
+        }
+        std::cout << "saved " << saveFile << " in " << msSince(start) << " ms\n";
+    }
+
+    logger_close();
+    PHYSFS_deinit();
+    return 0;
+}
@@ -12,7 +12,7 @@
 void mainmenu(World &w);
 void gameloop(World &w);
 bool loadGameData(World &w, const std::string &filename);
-bool buildmap(World &w, unsigned long seed);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
 void newgame(World &w);
 void keybinds();
 std::string keyName(int key);
@@ -54,6 +54,8 @@ int main(int argc, char *argv[]) {
     w.getRandom().seed(time(nullptr));
 
     w.configData = configRead("config.txt");
+    w.setSimulationLod(w.configData.simRadius, w.configData.simFarInterval);
+    w.setSaveCompression(w.configData.compressSaves);
     if (!loadGameData(w, "game.dat")) return 1;
 
     std::stringstream nameString;
@@ -112,9 +114,11 @@ void mainmenu(World &w) {
             case 0:
                 newgame(w);
                 break;
-            case 1: // load game
+            case 1: { // load game
+                const std::string saveFile = "game.sav";
                 ui_MessageBox_Instant("Loading saved game...");
-                if (w.loadgame("game.sav")) {
+                if (w.loadgame(saveFile)) {
+                    replayJournal(w, saveFile, commandAction);
                     w.inProgress = true;
                     logger_log("mainmenu (info): loaded game from save.");
                     logger_log("mainmenu (info): initial player position is "
@@ -125,7 +129,7 @@ void mainmenu(World &w) {
                     logger_log("mainmenu: failed to load save game.");
                     ui_MessageBox("Error", "Failed to load game.");
                 }
-                break;
+                break; }
             case 2: // continue game
                 if (w.inProgress) {
                     logger_log("mainmenu (info): resuming on previous map.");
@@ -149,7 +153,8 @@ Menu newgameMenu {
     {
         {   "World Name",       0,  false,  MENU_TEXT },
         {   "Seed",             1,  false,  MENU_TEXT },
-        {   "Size",             4,  false,  MENU_INT,   "", 128, 64, 1024 },
+        // a generated 4096 map holds about a million actors and 270 MB
+        {   "Size",             4,  false,  MENU_INT,   "", 128, 64, 4096 },
         {   "Begin",            2,  false,  MENU_SELECT },
         {   "Cancel",           3,  false,  MENU_SELECT },
     }
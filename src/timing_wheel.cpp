@@ -0,0 +1,70 @@
+#include "timing_wheel.h"
+
+TimingWheel::TimingWheel()
+: mNow(0), mCount(0)
+{ }
+
+void TimingWheel::reset(unsigned now) {
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            mSlots[level][slot].clear();
+        }
+    }
+    mOverdue.clear();
+    mNow = now;
+    mCount = 0;
+}
+
+void TimingWheel::schedule(unsigned due, unsigned value) {
+    ++mCount;
+    if (due <= mNow) {
+        mOverdue.push_back(Event{due, value});
+        return;
+    }
+    insert(Event{due, value});
+}
+
+// An event goes in the lowest level whose higher digits it shares with the
+// current turn, in the slot for its own digit at that level.
+void TimingWheel::insert(const Event &event) {
+    int level = 0;
+    while (level < LEVELS - 1 && (event.due ^ mNow) >> (SLOT_BITS * (level + 1))) {
+        ++level;
+    }
+    mSlots[level][(event.due >> (SLOT_BITS * level)) & SLOT_MASK].push_back(event);
+}
+
+void TimingWheel::cascade(int level) {
+    std::vector<Event> events;
+    events.swap(mSlots[level][(mNow >> (SLOT_BITS * level)) & SLOT_MASK]);
+    for (const Event &event : events) {
+        insert(event);
+    }
+}
+
+void TimingWheel::advance(unsigned now, std::vector<unsigned> &out) {
+    for (const Event &event : mOverdue) {
+        out.push_back(event.value);
+    }
+    mCount -= mOverdue.size();
+    mOverdue.clear();
+
+    while (mNow != now) {
+        ++mNow;
+        // when a digit rolls over, the next slot up empties into the levels below
+        int top = 0;
+        while (top < LEVELS - 1 && !(mNow & ((1u << (SLOT_BITS * (top + 1))) - 1))) {
+            ++top;
+        }
+        for (int level = top; level > 0; --level) {
+            cascade(level);
+        }
+
+        std::vector<Event> &slot = mSlots[0][mNow & SLOT_MASK];
+        for (const Event &event : slot) {
+            out.push_back(event.value);
+        }
+        mCount -= slot.size();
+        slot.clear();
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <vector>
+
+// Schedules values (such as actor handles) to come due on a given turn.
+// Events due within the next 256 turns sit in the first level's slots; later
+// ones wait in coarser levels and cascade down as the wheel turns, so
+// advancing one turn only touches the events that are actually due.
+class TimingWheel {
+public:
+    TimingWheel();
+    // Drops every event and sets the current turn.
+    void reset(unsigned now);
+    // Events due at or before the current turn come due on the next advance.
+    void schedule(unsigned due, unsigned value);
+    // Moves to turn now and appends every value due by then to out, in the
+    // order they came due and then the order they were scheduled.
+    void advance(unsigned now, std::vector<unsigned> &out);
+    unsigned now() const { return mNow; }
+    unsigned size() const { return mCount; }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const unsigned SLOT_MASK = SLOTS - 1;
+
+    struct Event {
+        unsigned due, value;
+    };
+
+    void insert(const Event &event);
+    void cascade(int level);
+
+    std::vector<Event> mSlots[LEVELS][SLOTS];
+    std::vector<Event> mOverdue;
+    unsigned mNow, mCount;
+};
+
+#endif
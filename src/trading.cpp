@@ -4,6 +4,10 @@
 
 void doTrading(World &w, Actor *left, Actor *right) {
     if (!left || !right) return;
+    // both inventories change below without the world or journal seeing it
+    w.touchActor(left);
+    w.touchActor(right);
+    w.markJournalGap();
     const unsigned highlightBG  = 0xFF666666;
     const unsigned highlightFG  = 0xFFFFFFFF;
     const unsigned textBG       = 0xFF000000;
@@ -0,0 +1,70 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(unsigned threadCount)
+: mJob(nullptr), mCount(0), mNext(0), mBusy(0), mGeneration(0), mStopping(false)
+{
+    if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+    for (unsigned i = 1; i < threadCount; ++i) {
+        mWorkers.push_back(std::thread(&WorkerPool::workerMain, this));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mStopping = true;
+    }
+    mWake.notify_all();
+    for (std::thread &worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int)> &job) {
+    if (mWorkers.empty()) {
+        for (int i = 0; i < count; ++i) job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mJob = &job;
+        mCount = count;
+        mNext = 0;
+        mBusy = mWorkers.size();
+        ++mGeneration;
+    }
+    mWake.notify_all();
+    runJobs();
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mDone.wait(lock, [this]() { return mBusy == 0; });
+    mJob = nullptr;
+}
+
+void WorkerPool::workerMain() {
+    unsigned seen = 0;
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mWake.wait(lock, [this, seen]() { return mStopping || mGeneration != seen; });
+            if (mStopping) return;
+            seen = mGeneration;
+        }
+        runJobs();
+        std::lock_guard<std::mutex> guard(mLock);
+        if (--mBusy == 0) mDone.notify_one();
+    }
+}
+
+void WorkerPool::runJobs() {
+    while (1) {
+        int i;
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+            if (mNext >= mCount) return;
+            i = mNext++;
+        }
+        (*mJob)(i);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that share out the iterations of parallelFor. The
+// calling thread takes part too, so a pool of one runs everything inline.
+class WorkerPool {
+public:
+    // threadCount 0 uses one thread per hardware core
+    explicit WorkerPool(unsigned threadCount = 0);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned size() const { return mWorkers.size() + 1; }
+    // Calls job(i) for every i in [0, count) and returns once all are done.
+    void parallelFor(int count, const std::function<void(int)> &job);
+
+private:
+    void workerMain();
+    void runJobs();
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mLock;
+    std::condition_variable mWake, mDone;
+    const std::function<void(int)> *mJob;
+    int mCount, mNext;
+    unsigned mBusy, mGeneration;
+    bool mStopping;
+};
+
+#endif
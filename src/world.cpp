@@ -1,8 +1,10 @@
 #include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <sstream>
-#include <physfs.h>
+#include "journal.h"
+#include "save_buffer.h"
 #include "world.h"
 
 
@@ -90,6 +92,38 @@ void Inventory::sort(int sortType) {
 }
 
 
+void makeLootAt(World &w, const LootTable *table, const Point &where, bool showMessages) {
+    if (!table || table->mRows.empty()) return;
+
+    Inventory inv;
+    for (const LootRow &row : table->mRows) {
+        if (row.ident < 0 || row.chance < 0 || row.max < 0) continue;
+        const ItemDef &def = w.getItemDef(row.ident);
+        if (def.ident < 0) continue;
+        int chance = w.getRandom().next32() % 100;
+        int qty = w.getRandom().between(row.min, row.max);
+        if (chance < row.chance) inv.add(&def, qty);
+    }
+
+    std::stringstream s;
+    for (InventoryRow &row : inv.mContents) {
+        row.qty = w.dropItems(where, row.def->ident, row.qty);
+    }
+
+    inv.cleanup();
+    if (inv.mContents.empty()) return;
+    s << " Dropped";
+    const unsigned invSize = inv.mContents.size();
+    for (unsigned i = 0; i < invSize; ++i) {
+        if (i != 0 && invSize > 2) s << ",";
+        if (i == invSize - 1 && invSize > 1) s << " and";
+        const InventoryRow &row = inv.mContents[i];
+        s << ' ' << itemStackName(*row.def, row.qty);
+    }
+    s << '.';
+    if (showMessages) w.appendLogMsg(s.str());
+}
+
 std::string Actor::getName() const {
     std::string name = "the " + def.name;
     if (health < def.health && health > 0) {
@@ -103,14 +137,14 @@ void Actor::reset() {
     health = def.health;
 }
 
-std::string Item::getName(bool forPural) const {
-    if (forPural) return def.plural;
+std::string itemStackName(const ItemDef &def, int qty) {
+    if (qty > 1) return std::to_string(qty) + " " + def.plural;
     return "a " + def.name;
 }
 
 
 World::World()
-: tickTime(0), renderTime(0), inProgress(false), mTiles(nullptr), mPlayer(nullptr), turn(0), day(1), hour(12), minute(0) {
+: tickTime(0), renderTime(0), inProgress(false), mWidth(0), mHeight(0), mChunksWide(0), mChunksHigh(0), mTrackChanges(false), mSaveDeltas(0), mSaveBaseSize(0), mSaveDeltaSize(0), mAutosaveDone(false), mAutosaveSnapshotTime(0), mJournal(new JournalWriter), mJournalTail(new SaveWriter), mJournalBatch(new SaveWriter), mJournalGap(false), mReplaying(false), mPlayerDeaths(0), mTickThreads(0), mSimRadius(0), mSimFarInterval(1), mCompressSaves(true), mBatchDepth(0), mPlayer(nullptr), turn(0), day(1), hour(12), minute(0) {
 }
 
 World::~World() {
@@ -128,28 +162,45 @@ void World::allocMap(int width, int height) {
     deallocMap();
     mWidth = width;
     mHeight = height;
-    mTiles = new Tile[width * height];
+    mChunksWide = (width + CHUNK_MASK) >> CHUNK_SHIFT;
+    mChunksHigh = (height + CHUNK_MASK) >> CHUNK_SHIFT;
+    mChunks = std::vector<MapChunk>(mChunksWide * mChunksHigh);
+    mChunkChanges.assign(mChunks.size(), 0);
+    mChangedChunks.clear();
+    mTrackChanges = false;
+    mChangedActors.clear();
+    mRemovedActors.clear();
+    mSaveFile.clear();
     turn = 0;
+    mGrowth.reset(turn);
 }
 
 void World::deallocMap() {
-    if (!mTiles) return;
-
-    for (int i = 0; i < mWidth * mHeight; ++i) {
-        delete mTiles->item;
-    }
-    delete[] mTiles;
-    mTiles = nullptr;
-
-    for (Actor *actor : mActors) {
-        if (!actor) logger_log("deallocMap: Found null actor in actor list.");
-        else        delete actor;
-    }
+    // the save being written belongs to the map about to go
+    finishAutosave(true);
+    flushJournal();
+    mJournal->wait();
+    mJournalFile.clear();
+    mJournalTail->data().clear();
+    mJournalBatch->data().clear();
+    if (mChunks.empty()) return;
+
+    mChunks.clear();
+    mRoomHandles.clear();
+    mActorHash.clear();
+    mItemHash.clear();
+
+    mActorSlab.clear();
     for (Room *room : mRooms) {
         if (!room)  logger_log("deallocMap: Found null room in room list.");
         else        delete room;
     }
     mActors.clear();
+    mActive.clear();
+    mDeadActors.clear();
+    mGrowth.reset(0);
+    mRooms.clear();
+    mDirtyRooms.clear();
     mLog.clear();
     mPlayer = nullptr;
 }
@@ -160,6 +211,28 @@ bool World::valid(const Point &p) const {
     return true;
 }
 
+void World::compactMap() {
+    for (MapChunk &chunk : mChunks) {
+        chunk.terrain.compact();
+        chunk.building.compact();
+        chunk.room.compact();
+        chunk.actor.compact();
+        chunk.item.compact();
+    }
+}
+
+unsigned long World::mapMemory() const {
+    unsigned long total = mChunks.size() * sizeof(MapChunk);
+    for (const MapChunk &chunk : mChunks) {
+        if (!chunk.terrain.uniform())   total += CHUNK_AREA * sizeof(short);
+        if (!chunk.building.uniform())  total += CHUNK_AREA * sizeof(short);
+        if (!chunk.room.uniform())      total += CHUNK_AREA * sizeof(unsigned);
+        if (!chunk.actor.uniform())     total += CHUNK_AREA * sizeof(unsigned);
+        if (!chunk.item.uniform())      total += CHUNK_AREA * sizeof(ItemStack);
+    }
+    return total;
+}
+
 
 
 const Point& World::getCamera() const {
@@ -170,17 +243,29 @@ void World::setCamera(const Point &to) {
     mCamera = to;
 }
 
+void World::centreCamera(const Point &on) {
+    const int viewWidth = 25;
+    const int viewHeight = 25;
+
+    setCamera(Point(on.x - viewWidth / 2, on.y - viewHeight / 2));
+}
 
 
-Point World::findDropSpace(const Point &near) const {
-    if (at(near).item == nullptr) return near;
+
+static bool canStack(const ItemStack &stack, int ident) {
+    return stack.empty() || (stack.ident == ident && stack.qty < ITEM_STACK_MAX);
+}
+
+Point World::findDropSpace(const Point &near, int ident) const {
+    if (valid(near) && canStack(at(near).item, ident)) return near;
     for (int i = 0; i < 8; ++i) {
         Dir d = static_cast<Dir>(i);
         Point p = near.shift(d);
+        if (!valid(p)) continue;
         const Tile &t = at(p);
-        if (getTileDef(t.terrain).solid) continue;
-        if (getTileDef(t.building).solid) continue;
-        if (t.item) continue;
+        if (getTileFlags(t.terrain) & TF_SOLID) continue;
+        if (getTileFlags(t.building) & TF_SOLID) continue;
+        if (!canStack(t.item, ident)) continue;
         if (t.actor && t.actor->def.type == TYPE_PLANT) continue;
         return p;
     }
@@ -188,78 +273,251 @@ Point World::findDropSpace(const Point &near) const {
 }
 
 
-const Tile& World::at(const Point &p) const {
+Tile World::at(const Point &p) const {
     if (!valid(p)) return BAD_TILE;
-    int c = p.x + p.y * mWidth;
-    return mTiles[c];
+    const MapChunk &chunk = chunkAt(p);
+    int c = cellOf(p);
+    Tile tile;
+    tile.terrain = chunk.terrain.get(c);
+    tile.building = chunk.building.get(c);
+    tile.room = mRoomHandles.get(chunk.room.get(c));
+    tile.actor = mActorSlab.get(chunk.actor.get(c));
+    tile.item = chunk.item.get(c);
+    return tile;
+}
+
+int World::getTerrain(const Point &p) const {
+    if (!valid(p)) return BAD_TILE.terrain;
+    return chunkAt(p).terrain.get(cellOf(p));
+}
+
+int World::getBuilding(const Point &p) const {
+    if (!valid(p)) return BAD_TILE.building;
+    return chunkAt(p).building.get(cellOf(p));
 }
 
 int World::getTileVariant(const Point &p) const {
-    if (!valid(p) || !getTileDef(at(p).building).connectingTile) return 0;
+    if (!valid(p) || !(getTileFlags(getBuilding(p)) & TF_CONNECTING)) return 0;
 
-    int wallGroup = getTileDef(at(p).building).wallGroup;
+    int wallGroup = getTileDef(getBuilding(p)).wallGroup;
     unsigned variant = 0;
-    if (getTileDef(at(p.shift(Dir::North)).building).wallGroup == wallGroup) variant |= 1;
-    if (getTileDef(at(p.shift(Dir::East)).building).wallGroup == wallGroup) variant |= 2;
-    if (getTileDef(at(p.shift(Dir::South)).building).wallGroup == wallGroup) variant |= 4;
-    if (getTileDef(at(p.shift(Dir::West)).building).wallGroup == wallGroup) variant |= 8;
+    if (getTileDef(getBuilding(p.shift(Dir::North))).wallGroup == wallGroup) variant |= 1;
+    if (getTileDef(getBuilding(p.shift(Dir::East))).wallGroup == wallGroup) variant |= 2;
+    if (getTileDef(getBuilding(p.shift(Dir::South))).wallGroup == wallGroup) variant |= 4;
+    if (getTileDef(getBuilding(p.shift(Dir::West))).wallGroup == wallGroup) variant |= 8;
     return variant;
 }
 
 void World::setActor(const Point &pos, Actor *toActor) {
     if (!valid(pos)) return;
-    int c = pos.x + pos.y * mWidth;
-    mTiles[c].actor = toActor;
+    ChunkPlane<unsigned> &plane = chunkAt(pos).actor;
+    int c = cellOf(pos);
+    Actor *oldActor = mActorSlab.get(plane.get(c));
+    if (toActor) touchActor(toActor);
+    if (oldActor && oldActor->def.type != TYPE_PLANT) mActorHash.remove(pos, oldActor);
+    if (toActor && toActor->def.type != TYPE_PLANT) mActorHash.insert(pos, toActor);
+    plane.set(c, toActor ? toActor->handle : 0);
 }
 
-void World::setItem(const Point &pos, Item *toItem) {
+void World::setItems(const Point &pos, const ItemStack &stack) {
     if (!valid(pos)) return;
-    int c = pos.x + pos.y * mWidth;
-    mTiles[c].item = toItem;
+    ChunkPlane<ItemStack> &plane = chunkAt(pos).item;
+    int c = cellOf(pos);
+    ItemStack oldStack = plane.get(c);
+    ItemStack newStack = stack.empty() ? ItemStack() : stack;
+    bool sameIdent = !oldStack.empty() && !newStack.empty() && oldStack.ident == newStack.ident;
+    if (!oldStack.empty() && !sameIdent) mItemHash[oldStack.ident].remove(pos, oldStack.ident);
+    if (!newStack.empty() && !sameIdent) mItemHash[newStack.ident].insert(pos, newStack.ident);
+    plane.set(c, newStack);
+    markChanged(pos, CHANGED_ITEMS);
+}
+
+int World::addItems(const Point &pos, int ident, int qty) {
+    if (!valid(pos) || qty <= 0) return 0;
+    ItemStack stack = chunkAt(pos).item.get(cellOf(pos));
+    if (!canStack(stack, ident)) return 0;
+    int added = std::min(qty, ITEM_STACK_MAX - stack.qty);
+    setItems(pos, ItemStack(ident, stack.qty + added));
+    return added;
+}
+
+int World::takeItems(const Point &pos, int qty) {
+    if (!valid(pos) || qty <= 0) return 0;
+    ItemStack stack = chunkAt(pos).item.get(cellOf(pos));
+    int taken = std::min(qty, static_cast<int>(stack.qty));
+    setItems(pos, ItemStack(stack.ident, stack.qty - taken));
+    return taken;
+}
+
+int World::dropItems(const Point &near, int ident, int qty) {
+    int dropped = 0;
+    while (dropped < qty) {
+        Point dest = findDropSpace(near, ident);
+        if (!valid(dest)) break;
+        dropped += addItems(dest, ident, qty - dropped);
+    }
+    return dropped;
 }
 
 void World::setTerrain(const Point &pos, int toTile) {
     if (!valid(pos)) return;
-    int c = pos.x + pos.y * mWidth;
-    mTiles[c].terrain = toTile;
+    MapChunk &chunk = chunkAt(pos);
+    int c = cellOf(pos);
+    bool wasFloor = isRoomFloor(pos);
+    chunk.terrain.set(c, toTile);
+    markChanged(pos, CHANGED_TILES);
 
-    // check for neccesary room updates
-    if (mTiles[c].room) {
-        rescaleRoom(mTiles[c].room);
-    }
-    Dir d = Dir::North;
-    do {
-        Point dest = pos.shift(d);
-        if (at(dest).room) rescaleRoom(at(dest).room);
-        d = rotate45(d);
-    } while (d != Dir::North);
+    // room extents only change if the tile stopped or started being floor
+    if (isRoomFloor(pos) != wasFloor) markRoomsDirty(pos);
+    if (mBatchDepth == 0) updateDirtyRooms();
 }
 
 void World::setBuilding(const Point &pos, int toTile) {
     if (!valid(pos)) return;
-    int c = pos.x + pos.y * mWidth;
-    mTiles[c].building = toTile;
+    MapChunk &chunk = chunkAt(pos);
+    int c = cellOf(pos);
+    int fromTile = chunk.building.get(c);
+    if (fromTile == toTile) return;
+    bool wasFloor = isRoomFloor(pos);
+    chunk.building.set(c, toTile);
+    markChanged(pos, CHANGED_TILES);
+
+    Room *room = mRoomHandles.get(chunk.room.get(c));
+    if (room) {
+        if (--room->buildings[fromTile] == 0) room->buildings.erase(fromTile);
+        ++room->buildings[toTile];
+    }
+
+    // room extents only change if the tile stopped or started being floor;
+    // otherwise the room it is in just needs classifying again
+    if (isRoomFloor(pos) != wasFloor) markRoomsDirty(pos);
+    else if (room) markRoomDirty(room, false);
+    if (mBatchDepth == 0) updateDirtyRooms();
+}
+
+void World::beginBatch() {
+    ++mBatchDepth;
+}
+
+void World::endBatch() {
+    if (mBatchDepth <= 0) {
+        logger_log("endBatch: called without matching beginBatch.");
+        return;
+    }
+    --mBatchDepth;
+    if (mBatchDepth == 0) updateDirtyRooms();
+}
+
+void World::setRaw(int layer, const Point &pos, int tile) {
+    if (!valid(pos)) return;
+    layerAt(pos, layer).set(cellOf(pos), tile);
+    markChanged(pos, CHANGED_TILES);
+}
+
+void World::fillSpan(int layer, int y, int x0, int x1, int tile, int onlyOver) {
+    if (y < 0 || y >= mHeight) return;
+    if (x0 < 0) x0 = 0;
+    if (x1 >= mWidth) x1 = mWidth - 1;
+    int x = x0;
+    while (x <= x1) {
+        Point p(x, y);
+        ChunkPlane<short> &plane = layerAt(p, layer);
+        markChanged(p, CHANGED_TILES);
+        int last = std::min(x1, x | CHUNK_MASK);
+        for (int c = cellOf(p); x <= last; ++x, ++c) {
+            if (onlyOver < 0 || plane.get(c) == onlyOver) plane.set(c, tile);
+        }
+    }
+}
 
-    // check for neccesary room updates
-    if (mTiles[c].room) {
-        rescaleRoom(mTiles[c].room);
+void World::fillRect(int layer, const Point &corner, int width, int height, int tile, int onlyOver) {
+    int left = std::max(corner.x, 0);
+    int top = std::max(corner.y, 0);
+    int right = std::min(corner.x + width, mWidth) - 1;
+    int bottom = std::min(corner.y + height, mHeight) - 1;
+    for (int y = top; y <= bottom; ) {
+        int chunkBottom = std::min(bottom, y | CHUNK_MASK);
+        for (int x = left; x <= right; ) {
+            int chunkRight = std::min(right, x | CHUNK_MASK);
+            bool wholeChunk = (x & CHUNK_MASK) == 0 && chunkRight - x == CHUNK_MASK
+                           && (y & CHUNK_MASK) == 0 && chunkBottom - y == CHUNK_MASK;
+            if (wholeChunk && onlyOver < 0) {
+                layerAt(Point(x, y), layer).fill(tile);
+                markChanged(Point(x, y), CHANGED_TILES);
+            } else {
+                for (int row = y; row <= chunkBottom; ++row) {
+                    fillSpan(layer, row, x, chunkRight, tile, onlyOver);
+                }
+            }
+            x = chunkRight + 1;
+        }
+        y = chunkBottom + 1;
     }
+}
+
+// Covers the same tiles as testing int(sqrt(dx*dx + dy*dy)) <= radius.
+void World::fillDisc(int layer, const Point &centre, int radius, int tile, int onlyOver) {
+    fillDiscClipped(layer, centre, radius, tile, onlyOver, Point(0, 0), mWidth, mHeight);
+}
+
+void World::fillDiscClipped(int layer, const Point &centre, int radius, int tile, int onlyOver,
+                            const Point &corner, int width, int height) {
+    const int limit = (radius + 1) * (radius + 1);
+    int top = std::max(centre.y - radius, corner.y);
+    int bottom = std::min(centre.y + radius, corner.y + height - 1);
+    for (int y = top; y <= bottom; ++y) {
+        int dy = y - centre.y;
+        int dx = std::sqrt(limit - 1 - dy * dy);
+        while (dx * dx + dy * dy >= limit) --dx;
+        while ((dx + 1) * (dx + 1) + dy * dy < limit) ++dx;
+        int x0 = std::max(centre.x - dx, corner.x);
+        int x1 = std::min(centre.x + dx, corner.x + width - 1);
+        if (x0 <= x1) fillSpan(layer, y, x0, x1, tile, onlyOver);
+    }
+}
+
+void World::finishBulkEdit() {
+    for (Room *room : mRooms) markRoomDirty(room, true);
+    if (mBatchDepth == 0) updateDirtyRooms();
+    compactMap();
+}
+
+void World::markRoomDirty(Room *room, bool rescale) {
+    if (!room) return;
+    if (!room->dirty) {
+        room->dirty = true;
+        mDirtyRooms.push_back(room);
+    }
+    if (rescale) room->needsRescale = true;
+}
+
+void World::markRoomsDirty(const Point &pos) {
+    markRoomDirty(at(pos).room, true);
     Dir d = Dir::North;
     do {
-        Point dest = pos.shift(d);
-        if (at(dest).room) rescaleRoom(at(dest).room);
+        markRoomDirty(at(pos.shift(d)).room, true);
         d = rotate45(d);
     } while (d != Dir::North);
 }
 
-bool World::moveActor(Actor *actor, const Point &to) {
-    if (!actor || (valid(to) && at(to).actor)) return false; // space already occupied
-
-    if (to.x == 0 && to.y == 0) {
-        setActor(actor->pos, nullptr);
-        actor->pos = to;
-        return true;
+// Rescaling a room can remove others still waiting here; removeRoom clears
+// their entries rather than erasing them, so the walk by index holds.
+void World::updateDirtyRooms() {
+    for (unsigned i = 0; i < mDirtyRooms.size(); ++i) {
+        Room *room = mDirtyRooms[i];
+        if (!room) continue;
+        bool rescale = room->needsRescale;
+        room->dirty = false;
+        room->needsRescale = false;
+        if (rescale)    rescaleRoom(room);
+        else            updateRoom(room);
     }
+    mDirtyRooms.clear();
+}
+
+bool World::moveActor(Actor *actor, const Point &to) {
+    if (!actor || actor->dead) return false;
+    if (valid(to) && at(to).actor) return false; // space already occupied
 
     if (valid(actor->pos) && at(actor->pos).actor == actor) {
         if (!valid(to)) {
@@ -270,7 +528,7 @@ bool World::moveActor(Actor *actor, const Point &to) {
             setActor(actor->pos, nullptr);
         }
     } else {
-        mActors.push_back(actor);
+        listActor(actor);
     }
 
     if (valid(to)) {
@@ -281,79 +539,222 @@ bool World::moveActor(Actor *actor, const Point &to) {
     return true;
 }
 
-const Actor* World::getPlayer() const {
-    return mPlayer;
+Actor* World::createActor(const ActorDef &def) {
+    unsigned handle = mActorSlab.create(def);
+    if (!handle) {
+        logger_log("createActor: actor slab is full.");
+        return nullptr;
+    }
+    Actor *actor = mActorSlab.get(handle);
+    actor->handle = handle;
+    return actor;
 }
 
-Actor* World::getPlayer() {
-    return mPlayer;
+void World::destroyActor(Actor *actor) {
+    if (!actor) return;
+    if (!mActorSlab.destroy(actor->handle)) {
+        logger_log("destroyActor: actor was already destroyed.");
+    }
 }
 
-bool World::moveItem(Item *item, const Point &to) {
-    if (!item || (valid(to) && at(to).item)) return false; // space already occupied
+Actor* World::getActor(unsigned handle) const {
+    return mActorSlab.get(handle);
+}
 
-    if (valid(item->pos) && at(item->pos).item == item) {
-        if (!valid(to)) {
-            logger_log("moveItem: Moving item (" + item->def.name + ") at " + item->pos.toString() + " to invalid position.");
-            removeItem(item);
-        } else {
-            setItem(item->pos, nullptr);
-        }
+// Plants always age one year per turn, so they can be left alone until the
+// turn they are due to grow instead of being visited every tick.
+static bool onSchedule(const ActorDef &def) {
+    return def.type == TYPE_PLANT && def.moveChance >= 1000;
+}
+
+// first turn on which a scheduled actor grows
+static unsigned growthTurn(const Actor *actor) {
+    int wait = actor->def.growTime - 1 - actor->age;
+    return actor->ageTurn + 1 + (wait > 0 ? wait : 0);
+}
+
+// Actors outside the simulation radius can lag behind by up to
+// mSimFarInterval turns; their age is brought up to date when they next act.
+int World::getActorAge(const Actor *actor) const {
+    if (!onSchedule(actor->def)) return actor->age;
+    return actor->age + static_cast<int>(turn - actor->ageTurn);
+}
+
+void World::listActor(Actor *actor) {
+    mActors.push_back(actor);
+    actor->ageTurn = turn;
+    if (!onSchedule(actor->def)) {
+        mActive.push_back(actor);
+        return;
     }
+    if (actor->def.growTo >= 0) mGrowth.schedule(growthTurn(actor), actor->handle);
+}
 
-    if (valid(to)) {
-        setItem(to, item);
+void World::growActor(Actor *actor) {
+    const ActorDef &def = getActorDef(actor->def.growTo);
+    if (def.ident == -1) {
+        actor->age = -9999;
+        logger_log(actor->def.name + " at " + actor->pos.toString() + " has invalid next growth state.");
+        return;
     }
-    item->pos = to;
-    return true;
+    Actor *newActor = createActor(def);
+    if (!newActor) return;
+    newActor->reset();
+    Point pos = actor->pos;
+    removeActor(actor);
+    moveActor(newActor, pos);
+    if (def.growTo < 0) mMatured.push_back(pos);
+}
+
+const Actor* World::getPlayer() const {
+    return mPlayer;
+}
+
+Actor* World::getPlayer() {
+    return mPlayer;
 }
 
 void World::removeActor(Actor *actor) {
-    if (at(actor->pos).actor != actor) return;
-    setActor(actor->pos, nullptr);
-    auto iter = mActors.begin();
-    while (iter != mActors.end()) {
-        if (*iter == actor) {
-            iter = mActors.erase(iter);
-        } else {
-            ++iter;
+    if (!actor || actor->dead) return;
+    if (at(actor->pos).actor == actor) setActor(actor->pos, nullptr);
+    actor->dead = true;
+    mDeadActors.push_back(actor);
+}
+
+// Drops every actor removed since the last call from the actor list in a
+// single pass and destroys them. The player is kept and respawned instead.
+void World::purgeDeadActors() {
+    if (mDeadActors.empty()) return;
+    Actor *player = mPlayer;
+    auto isPurged = [player](const Actor *actor) {
+        return actor->dead && actor != player;
+    };
+    mActors.erase(std::remove_if(mActors.begin(), mActors.end(), isPurged), mActors.end());
+    mActive.erase(std::remove_if(mActive.begin(), mActive.end(), isPurged), mActive.end());
+
+    bool playerDied = false;
+    for (Actor *actor : mDeadActors) {
+        if (actor == player) {
+            playerDied = true;
+            continue;
         }
+        if (valid(actor->savedPos)) mRemovedActors.push_back(actor->savedPos);
+        destroyActor(actor);
     }
+    mDeadActors.clear();
+    // drop the handles of destroyed actors before they pile up between saves
+    if (mChangedActors.size() > mActors.size() * 2 + 64) {
+        auto destroyed = [this](unsigned handle) { return !getActor(handle); };
+        mChangedActors.erase(std::remove_if(mChangedActors.begin(), mChangedActors.end(), destroyed),
+                             mChangedActors.end());
+    }
+    if (playerDied) respawnPlayer();
 }
 
-void World::removeItem(Item *item) {
-    if (at(item->pos).item != item) return;
-    setItem(item->pos, nullptr);
-}
-
-std::vector<Point> World::findRoomExtents(const Point &pos) const {
-    std::vector<Point> result;
+void World::respawnPlayer() {
+    Actor *actor = mPlayer;
+    ++mPlayerDeaths;
+    actor->reset();
+    actor->dead = false;
+    Point p;
+    do {
+        p.x = mRandom.next32() % mWidth;
+        p.y = mRandom.next32() % mHeight;
+    } while ((getTileFlags(at(p).terrain) & TF_SOLID) || at(p).actor);
+    // the player never left the actor list, so place it directly
+    setActor(p, actor);
+    actor->pos = p;
+    addLogMsg("You have died! Respawning...");
+    logger_log("tick (info): respawning player at " + p.toString() + ".");
+    centreCamera(actor->pos);
+}
+
+unsigned World::itemCount() const {
+    unsigned count = 0;
+    for (const auto &items : mItemHash) {
+        count += items.second.size();
+    }
+    return count;
+}
+
+bool World::isRoomFloor(const Point &pos) const {
+    if (!valid(pos)) return false;
+    int building = getBuilding(pos);
+    if (building != 0 && (getTileFlags(building) & TF_WALL)) return false;
+    return !(getTileFlags(getTerrain(pos)) & TF_SOLID);
+}
+
+// Scanline flood fill over the eight-connected floor tiles around pos. The
+// starting tile is always part of the result. Returns an empty mask if the
+// area is too large to be a room or runs out to the map edge, stopping as
+// soon as either is found so open ground is cheap to reject.
+TileMask World::findRoomExtents(const Point &pos) const {
+    struct Span {
+        int y, x0, x1;
+    };
+
+    TileMask result;
+    if (!valid(pos)) return result;
+    mRoomVisited.resize((mWidth * mHeight + 31) / 32, 0);
+    auto visited = [this](int x, int y) {
+        int i = x + y * mWidth;
+        return (mRoomVisited[i >> 5] & (1u << (i & 31))) != 0;
+    };
+
+    std::vector<Span> spans;
     std::vector<Point> todo;
+    int left = pos.x, right = pos.x, top = pos.y, bottom = pos.y;
+    bool notRoom = false;
     todo.push_back(pos);
-    while (!todo.empty()) {
-        Point pos = todo.back();
+    while (!todo.empty() && !notRoom) {
+        Point here = todo.back();
         todo.pop_back();
-        bool alreadyDone = false;
-        for (const Point &p : result) {
-            if (p == pos) {
-                alreadyDone = true;
-                break;
-            }
+        if (visited(here.x, here.y)) continue;
+
+        int x0 = here.x, x1 = here.x;
+        if (isRoomFloor(here)) {
+            while (x0 > 0 && !visited(x0 - 1, here.y) && isRoomFloor(Point(x0 - 1, here.y))) --x0;
+            while (x1 < mWidth - 1 && !visited(x1 + 1, here.y) && isRoomFloor(Point(x1 + 1, here.y))) ++x1;
+            if (x0 == 0 || x1 == mWidth - 1 || here.y == 0 || here.y == mHeight - 1) notRoom = true;
         }
-        if (alreadyDone) continue;
-        result.push_back(pos);
-
-        Dir d = Dir::North;
-        do {
-            Point dest = pos.shift(d);
-            if (valid(dest) && (at(dest).building == 0 || !getTileDef(at(dest).building).isWall) && !getTileDef(at(dest).terrain).solid) {
-                todo.push_back(dest);
+        for (int x = x0; x <= x1; ++x) {
+            int i = x + here.y * mWidth;
+            mRoomVisited[i >> 5] |= 1u << (i & 31);
+        }
+        spans.push_back(Span{here.y, x0, x1});
+
+        if (x0 < left)       left = x0;
+        if (x1 > right)      right = x1;
+        if (here.y < top)    top = here.y;
+        if (here.y > bottom) bottom = here.y;
+        if ((right - left + 1) * (bottom - top + 1) > ROOM_MAX_AREA) {
+            notRoom = true;
+        }
+
+        // queue the start of each unvisited run of floor touching this span
+        for (int y = here.y - 1; y <= here.y + 1; ++y) {
+            if (y < 0 || y >= mHeight) continue;
+            bool inRun = false;
+            for (int x = std::max(x0 - 1, 0); x <= std::min(x1 + 1, mWidth - 1); ++x) {
+                Point next(x, y);
+                if (!visited(x, y) && isRoomFloor(next)) {
+                    if (!inRun) todo.push_back(next);
+                    inRun = true;
+                } else {
+                    inRun = false;
+                }
             }
-            d = rotate45(d);
-        } while (d != Dir::North);
+        }
+    }
 
-        if (result.size() > 100) {
-            return std::vector<Point>{};
+    if (!notRoom) {
+        result.reset(Point(left, top), right - left + 1, bottom - top + 1);
+    }
+    for (const Span &span : spans) {
+        for (int x = span.x0; x <= span.x1; ++x) {
+            int i = x + span.y * mWidth;
+            mRoomVisited[i >> 5] &= ~(1u << (i & 31));
+            if (!notRoom) result.insert(Point(x, span.y));
         }
     }
     return result;
@@ -362,27 +763,41 @@ std::vector<Point> World::findRoomExtents(const Point &pos) const {
 void World::addRoom(Room *room) {
     if (!room) return;
     mRooms.push_back(room);
-    for (const Point &pos : room->points) {
-        if (!valid(pos)) continue;
-        int c = pos.x + pos.y * mWidth;
-        mTiles[c].room = room;
-    }
+    room->handle = mRoomHandles.add(room);
+    room->tiles.forEach([this, room](const Point &pos) {
+        if (!valid(pos)) return;
+        chunkAt(pos).room.set(cellOf(pos), room->handle);
+    });
+    countBuildings(room);
+}
+
+void World::countBuildings(Room *room) {
+    room->buildings.clear();
+    room->tiles.forEach([this, room](const Point &pos) {
+        ++room->buildings[getBuilding(pos)];
+    });
 }
 
 bool World::createRoom(const Point &initial) {
-    std::vector<Point> points = findRoomExtents(initial);
-    if (points.empty()) return false;
+    TileMask tiles = findRoomExtents(initial);
+    if (tiles.empty()) return false;
     Room *room = new Room;
-    room->points = points;
+    room->tiles = std::move(tiles);
     addRoom(room);
     updateRoom(room);
     return true;
 }
 
 void World::removeRoom(Room *room) {
-    for (const Point &pos : room->points) {
-        int c = pos.x + pos.y * mWidth;
-        mTiles[c].room = nullptr;
+    room->tiles.forEach([this](const Point &pos) {
+        chunkAt(pos).room.set(cellOf(pos), 0);
+    });
+    mRoomHandles.remove(room->handle);
+    room->handle = 0;
+    if (room->dirty) {
+        room->dirty = false;
+        room->needsRescale = false;
+        *std::find(mDirtyRooms.begin(), mDirtyRooms.end(), room) = nullptr;
     }
 
     auto iter = mRooms.begin();
@@ -398,12 +813,9 @@ void World::removeRoom(Room *room) {
 bool World::rescaleRoom(Room *room) {
     Point initial = nowhere;
 
-    for (const Point &p : room->points) {
-        if (!getTileDef(at(p).terrain).isWall) {
-            initial = p;
-            break;
-        }
-    }
+    room->tiles.forEach([this, &initial](const Point &p) {
+        if (!valid(initial) && isRoomFloor(p)) initial = p;
+    });
     if (!valid(initial)) {
         addLogMsg("Destroyed " + room->def->name + ".");
         removeRoom(room);
@@ -411,7 +823,7 @@ bool World::rescaleRoom(Room *room) {
         return false;
     }
 
-    auto extents = findRoomExtents(initial);
+    TileMask extents = findRoomExtents(initial);
     if (extents.empty()) {
         addLogMsg("Destroyed " + room->def->name + ".");
         removeRoom(room);
@@ -419,53 +831,48 @@ bool World::rescaleRoom(Room *room) {
         return false;
     }
 
-    for (const Point &p : room->points) {
-        int c = p.x + p.y * mWidth;
-        mTiles[c].room = nullptr;
-    }
-    for (const Point &p : extents) {
-        int c = p.x + p.y * mWidth;
-        if (mTiles[c].room && mTiles[c].room != room) {
-            addLogMsg("Destroyed " + mTiles[c].room->def->name + ".");
-            removeRoom(mTiles[c].room);
+    room->tiles.forEach([this](const Point &p) {
+        chunkAt(p).room.set(cellOf(p), 0);
+    });
+    extents.forEach([this, room](const Point &p) {
+        ChunkPlane<unsigned> &plane = chunkAt(p).room;
+        int c = cellOf(p);
+        if (plane.get(c) && plane.get(c) != room->handle) {
+            Room *other = mRoomHandles.get(plane.get(c));
+            addLogMsg("Destroyed " + other->def->name + ".");
+            removeRoom(other);
         }
-        mTiles[c].room = room;
-    }
-    if (extents.size() < room->points.size()) {
+        plane.set(c, room->handle);
+    });
+    if (extents.size() < room->tiles.size()) {
         addLogMsg("The " + room->def->name + " became smaller.");
-    } else if (extents.size() > room->points.size()) {
+    } else if (extents.size() > room->tiles.size()) {
         addLogMsg("The " + room->def->name + " became larger.");
     }
 
-    room->points = extents;
+    room->tiles = std::move(extents);
+    countBuildings(room);
     updateRoom(room);
     return true;
 }
 
 void World::updateRoom(Room *room) {
-    int score = 0;
     const RoomDef *theDef = nullptr;
 
+    // room defs are sorted by value, so the first match is the best one
     for (const RoomDef &def : mRoomDefs) {
-        if (def.value <= score) continue;
+        if (def.value <= 0) break;
         bool isMatch = true;
         for (int tile : def.requirements) {
-            bool met = false;
-            for (const Point &p : room->points) {
-                if (at(p).building == tile) {
-                    met = true;
-                    break;
-                }
-            }
-            if (!met) {
+            if (room->buildings.count(tile) == 0) {
                 isMatch = false;
                 break;
             }
         }
 
         if (isMatch) {
-            score = def.value;
             theDef = &def;
+            break;
         }
     }
 
@@ -480,41 +887,36 @@ void World::updateRoom(Room *room) {
 
 
 Point World::findItemNearest(const Point &to, int itemIdent, int radius) const {
+    auto items = mItemHash.find(itemIdent);
+    if (items == mItemHash.end() || items->second.size() == 0) return nowhere;
+
     Point result = nowhere;
-    double distance = 999999.0;
-    for (int y = to.y - radius; y <= to.y + radius; ++y) {
-        for (int x = to.x - radius; x <= to.x + radius; ++x) {
-            Point here(x, y);
-            const Tile &tile = at(here);
-            if (tile.item && tile.item->def.ident == itemIdent) {
-                double myDist = here.distance(to);
-                if (myDist < distance) {
-                    result = here;
-                    distance = myDist;
-                }
-            }
+    int distance = -1;
+    items->second.forEachNear(to, radius, [&](const Point &here, int ident) {
+        int myDist = (here.x - to.x) * (here.x - to.x) + (here.y - to.y) * (here.y - to.y);
+        if (distance < 0 || myDist < distance
+                || (myDist == distance && (here.y < result.y || (here.y == result.y && here.x < result.x)))) {
+            result = here;
+            distance = myDist;
         }
-    }
+    });
     return result;
 }
 
 Point World::findActorNearest(const Point &to, int notOfFaction, int radius) const {
     Point result = nowhere;
-    double distance = 999999.0;
-    for (int y = to.y - radius; y <= to.y + radius; ++y) {
-        for (int x = to.x - radius; x <= to.x + radius; ++x) {
-            Point here(x, y);
-            const Tile &tile = at(here);
-            if (!tile.actor || tile.actor->def.type == TYPE_PLANT) continue;
-            if (notOfFaction < 0 || tile.actor->faction != notOfFaction) {
-                double myDist = here.distance(to);
-                if (myDist < distance) {
-                    result = here;
-                    distance = myDist;
-                }
-            }
+    int distance = -1;
+    mActorHash.forEachNear(to, radius, [&](const Point &here, const Actor *actor) {
+        if (notOfFaction >= 0 && actor->faction == notOfFaction) return;
+        // compare squared distances; ties go to the first position in
+        // reading order, as with a row by row scan
+        int myDist = (here.x - to.x) * (here.x - to.x) + (here.y - to.y) * (here.y - to.y);
+        if (distance < 0 || myDist < distance
+                || (myDist == distance && (here.y < result.y || (here.y == result.y && here.x < result.x)))) {
+            result = here;
+            distance = myDist;
         }
-    }
+    });
     return result;
 }
 
@@ -527,6 +929,7 @@ void World::doDamage(Actor *attacker, Actor *victim) {
     bool showMsgs = mPlayer->pos.distance(victim->pos) < 10;
     int damage = attacker->def.baseDamage;
     victim->health -= damage;
+    touchActor(victim);
 
     std::stringstream msg;
     msg << upperFirst(attacker->getName()) << " does " << damage << " damage to " << victim->getName() << ".";
@@ -538,10 +941,9 @@ void World::doDamage(Actor *attacker, Actor *victim) {
         if (victim->def.type == TYPE_PLANT) deathMsg << " breaks.";
         else                                deathMsg << " dies.";
         if (showMsgs) appendLogMsg(deathMsg.str());
-        Point oldPos = victim->pos;
-        moveActor(victim, Point(0, 0));
+        removeActor(victim);
         if (victim->def.loot) {
-            makeLootAt(*this, victim->def.loot, oldPos, showMsgs);
+            makeLootAt(*this, victim->def.loot, victim->pos, showMsgs);
         }
     }
 
@@ -570,35 +972,54 @@ const LogMessage& World::getLogMsg(int index) const {
 
 void World::addActorDef(const ActorDef &ad) {
     mActorDefs.push_back(ad);
+    mActorIndex.clear();
 }
 
 const ActorDef& World::getActorDef(int ident) const {
-    for (const ActorDef &ad : mActorDefs) {
-        if (ad.ident == ident) return ad;
+    if (mActorIndex.empty()) {
+        // still loading data files; fall back to searching the list
+        for (const ActorDef &ad : mActorDefs) {
+            if (ad.ident == ident) return ad;
+        }
+        return BAD_ACTORDEF;
     }
-    return BAD_ACTORDEF;
+    int slot = mActorIndex.slot(ident);
+    if (slot < 0) return BAD_ACTORDEF;
+    return mActorDefs[slot];
 }
 
 void World::addItemDef(const ItemDef &td) {
     mItemDefs.push_back(td);
+    mItemIndex.clear();
 }
 
 const ItemDef& World::getItemDef(int ident) const {
-    for (const ItemDef &td : mItemDefs) {
-        if (td.ident == ident) return td;
+    if (mItemIndex.empty()) {
+        for (const ItemDef &td : mItemDefs) {
+            if (td.ident == ident) return td;
+        }
+        return BAD_ITEMDEF;
     }
-    return BAD_ITEMDEF;
+    int slot = mItemIndex.slot(ident);
+    if (slot < 0) return BAD_ITEMDEF;
+    return mItemDefs[slot];
 }
 
 void World::addTileDef(const TileDef &td) {
     mTileDefs.push_back(td);
+    mTileIndex.clear();
 }
 
 const TileDef& World::getTileDef(int ident) const {
-    for (const TileDef &td : mTileDefs) {
-        if (td.ident == ident) return td;
+    if (mTileIndex.empty()) {
+        for (const TileDef &td : mTileDefs) {
+            if (td.ident == ident) return td;
+        }
+        return BAD_TILEDEF;
     }
-    return BAD_TILEDEF;
+    int slot = mTileIndex.slot(ident);
+    if (slot < 0) return BAD_TILEDEF;
+    return mTileDefs[slot];
 }
 
 void World::addRecipeDef(const RecipeDef &td) {
@@ -617,13 +1038,45 @@ std::vector<const RecipeDef*> World::getRecipeList(unsigned stations) const {
 
 void World::addRoomDef(const RoomDef &rd) {
     mRoomDefs.push_back(rd);
+    mRoomIndex.clear();
 }
 
 const RoomDef& World::getRoomDef(int ident) const {
-    for (const RoomDef &td : mRoomDefs) {
-        if (td.ident == ident) return td;
+    if (mRoomIndex.empty()) {
+        for (const RoomDef &td : mRoomDefs) {
+            if (td.ident == ident) return td;
+        }
+        return BAD_ROOMDEF;
     }
-    return BAD_ROOMDEF;
+    int slot = mRoomIndex.slot(ident);
+    if (slot < 0) return BAD_ROOMDEF;
+    return mRoomDefs[slot];
+}
+
+void World::indexDefs() {
+    // must happen before any rooms exist as they point into mRoomDefs
+    std::stable_sort(mRoomDefs.begin(), mRoomDefs.end(),
+            [](const RoomDef &a, const RoomDef &b) {
+                return a.value > b.value;
+            });
+
+    if (!mActorIndex.build(mActorDefs)) logger_log("indexDefs: actor idents too widely spread to index.");
+    if (!mItemIndex.build(mItemDefs))   logger_log("indexDefs: item idents too widely spread to index.");
+    if (!mTileIndex.build(mTileDefs))   logger_log("indexDefs: tile idents too widely spread to index.");
+    if (!mRoomIndex.build(mRoomDefs))   logger_log("indexDefs: room idents too widely spread to index.");
+
+    mTileFlags.clear();
+    for (const TileDef &td : mTileDefs) mTileFlags.push_back(tileFlags(td));
+}
+
+unsigned World::tileFlags(const TileDef &td) {
+    unsigned flags = 0;
+    if (td.solid)           flags |= TF_SOLID;
+    if (td.opaque)          flags |= TF_OPAQUE;
+    if (td.ground)          flags |= TF_GROUND;
+    if (td.isWall)          flags |= TF_WALL;
+    if (td.connectingTile)  flags |= TF_CONNECTING;
+    return flags;
 }
 
 bool World::tryMoveActor(Actor *actor, Dir baseDir, bool allowSidestep) {
@@ -634,8 +1087,8 @@ bool World::tryMoveActor(Actor *actor, Dir baseDir, bool allowSidestep) {
     else {
         const Tile &tile = at(dest);
         if (tile.actor) blocked = true;
-        else if (getTileDef(tile.terrain).solid) blocked = true;
-        else if (tile.building > 0 && getTileDef(tile.building).solid) blocked = true;
+        else if (getTileFlags(tile.terrain) & TF_SOLID) blocked = true;
+        else if (tile.building > 0 && (getTileFlags(tile.building) & TF_SOLID)) blocked = true;
     }
 
     if (!blocked) {
@@ -664,105 +1117,242 @@ void World::tick() {
         ++day;
     }
 
-    for (unsigned i = 0; i < mActors.size(); ++i) {
-        Actor *actor = mActors[i];
-        if (mRandom.next32() % 1000 >= static_cast<unsigned>(actor->def.moveChance)) continue;
+    mMatured.clear();
+
+    // Pick who acts this turn: everyone near the player, plus the share of
+    // distant actors whose turn it is. Both are taken in mActive order, but
+    // the share is keyed on the handle, which doesn't shift as mActive does.
+    mTurnActors.clear();
+    const bool useLod = mSimRadius > 0 && mPlayer;
+    const unsigned phase = turn % mSimFarInterval;
+    for (unsigned i = 0; i < mActive.size(); ++i) {
+        Actor *actor = mActive[i];
+        if (useLod && actor->handle % mSimFarInterval != phase) {
+            int dx = std::abs(actor->pos.x - mPlayer->pos.x);
+            int dy = std::abs(actor->pos.y - mPlayer->pos.y);
+            if (dx > mSimRadius || dy > mSimRadius) continue;
+        }
+        catchUpActor(actor);
+        mTurnActors.push_back(actor);
+    }
+
+    // plan those turns in parallel, then apply them in order
+    if (!mPool) mPool.reset(new WorkerPool(mTickThreads));
+    const unsigned actorCount = mTurnActors.size();
+    const std::uint64_t tickSeed = mRandom.next64();
+    const int blockSize = 1024;
+    mIntents.resize(actorCount);
+    mPool->parallelFor((actorCount + blockSize - 1) / blockSize, [this, actorCount, tickSeed](int block) {
+        unsigned last = std::min(actorCount, static_cast<unsigned>(block + 1) * blockSize);
+        for (unsigned i = block * blockSize; i < last; ++i) {
+            Random rng;
+            rng.seed(mixSeed(tickSeed + i));
+            mIntents[i] = planTurn(mTurnActors[i], rng);
+        }
+    });
+
+    beginBatch();
+    for (unsigned i = 0; i < actorCount; ++i) {
+        applyTurn(mTurnActors[i], mIntents[i]);
+    }
+
+    mDueActors.clear();
+    mGrowth.advance(turn, mDueActors);
+    for (unsigned handle : mDueActors) {
+        // the handle may have been reused since, so check it is really due
+        Actor *actor = getActor(handle);
+        if (actor && !actor->dead && onSchedule(actor->def) && growthTurn(actor) == turn) {
+            growActor(actor);
+        }
+    }
 
-        ++actor->age;
+    purgeDeadActors();
+    endBatch();
 
-        if (actor->def.type == TYPE_VILLAGER) {
-            Dir dir = static_cast<Dir>(mRandom.next32() % 8);
-            tryMoveActor(actor, dir);
+    if (selection >= mPlayer->inventory.size()) {
+        selection = mPlayer->inventory.size() - 1;
+    }
+    if (selection < 0) selection = 0;
 
-        } else if (actor->def.type == TYPE_MONSTER) {
-            Point victimPos = findActorNearest(actor->pos, actor->faction, 8);
-            if (valid(victimPos)) {
-                if (victimPos.distance(actor->pos) < 2) {
-                    const Tile &tile = at(victimPos);
-                    doDamage(actor, tile.actor);
-                } else {
-                    tryMoveActor(actor, actor->pos.directionTo(victimPos));
-                }
-            } else {
-                Dir dir = static_cast<Dir>(mRandom.next32() % 8);
-                tryMoveActor(actor, dir);
-            }
+    auto tickEnd = std::chrono::high_resolution_clock::now();
+    tickTime = std::chrono::duration_cast<std::chrono::microseconds>(tickEnd - tickStart).count();
 
-        } else if (actor->def.type == TYPE_ANIMAL) {
-            if (actor->def.foodItem >= 0) {
-                Point foodPos = findItemNearest(actor->pos, actor->def.foodItem, 8);
-                if (valid(foodPos)) {
-                    Dir d = actor->pos.directionTo(foodPos);
-                    if (d == Dir::None) {
-                        // on food item, eat it
-                        const Tile &tile = at(foodPos);
-                        Item *item = tile.item;
-                        if (item) {
-                            removeItem(item);
-                            delete item;
-                        }
-                    } else {
-                        // move towards food
-                        tryMoveActor(actor, d);
-                    }
-                    continue;
-                }
-            }
+}
 
-            Dir dir = static_cast<Dir>(mRandom.next32() % 8);
-            tryMoveActor(actor, dir);
+RestResult World::rest(int maxTurns, unsigned stopOn, int radius,
+                       const std::function<bool(int)> &progress) {
+    RestResult result{REST_FINISHED, 0};
+    if ((stopOn & REST_ON_HOSTILE) && hostileNear(mPlayer->pos, radius)) {
+        result.reason = REST_HOSTILE;
+        return result;
+    }
 
-        } else if (actor->def.type == TYPE_PLANT) {
-            if (actor->def.growTo >= 0 && actor->age >= actor->def.growTime) {
-                const ActorDef &def = getActorDef(actor->def.growTo);
-                if (def.ident == -1) {
-                    actor->age = -9999;
-                    logger_log(actor->def.name + " at " + actor->pos.toString() + " has invalid next growth state.");
-                } else {
-                    Actor *newActor = new Actor(def);
-                    newActor->reset();
-                    mActors[i] = newActor;
-                    newActor->pos = actor->pos;
-                    setActor(actor->pos, newActor);
-                    delete actor;
+    auto start = std::chrono::high_resolution_clock::now();
+    auto lastProgress = start;
+    while (result.turns < maxTurns) {
+        int health = mPlayer->health;
+        unsigned deaths = mPlayerDeaths;
+        tick();
+        ++result.turns;
+
+        if ((stopOn & REST_ON_DAMAGE) && (mPlayerDeaths != deaths || mPlayer->health < health)) {
+            result.reason = REST_DAMAGED;
+            break;
+        }
+        if ((stopOn & REST_ON_HOSTILE) && hostileNear(mPlayer->pos, radius)) {
+            result.reason = REST_HOSTILE;
+            break;
+        }
+        if (stopOn & REST_ON_CROP) {
+            bool matured = false;
+            for (const Point &p : mMatured) {
+                if (std::abs(p.x - mPlayer->pos.x) <= radius && std::abs(p.y - mPlayer->pos.y) <= radius) {
+                    matured = true;
                 }
             }
+            if (matured) {
+                result.reason = REST_CROP;
+                break;
+            }
+        }
+
+        // report progress a few times a second rather than every turn
+        auto now = std::chrono::high_resolution_clock::now();
+        if (progress && now - lastProgress >= std::chrono::milliseconds(100)) {
+            lastProgress = now;
+            if (!progress(result.turns)) {
+                result.reason = REST_CANCELLED;
+                break;
+            }
         }
     }
 
-    auto iter = mActors.begin();
-    while (iter != mActors.end()) {
-        if ((*iter)->pos.x == 0 && (*iter)->pos.y == 0) {
-            Actor *actor = *iter;
-            if (actor->def.type == TYPE_PLAYER) {
-                actor->reset();
-                Point p;
-                do {
-                    p.x = mRandom.next32() % mWidth;
-                    p.y = mRandom.next32() % mHeight;
-                } while (getTileDef(at(p).terrain).solid || at(p).actor);
-                moveActor(actor, p);
-                addLogMsg("You have died! Respawning...");
-                logger_log("tick (info): respawning player at " + p.toString() + ".");
-                actionCentrePan(*this, actor, Command{}, true);
-                ++iter;
+    auto end = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::stringstream msg;
+    msg << "rest (info): ran " << result.turns << " turns in " << static_cast<int>(seconds * 1000) << " ms";
+    if (seconds > 0) msg << " (" << static_cast<int>(result.turns / seconds) << " turns/s)";
+    msg << ", stopped with reason " << result.reason << '.';
+    logger_log(msg.str());
+    return result;
+}
+
+bool World::hostileNear(const Point &pos, int radius) const {
+    bool found = false;
+    mActorHash.forEachNear(pos, radius, [&found](const Point &here, const Actor *actor) {
+        if (actor->def.type == TYPE_MONSTER) found = true;
+    });
+    return found;
+}
+
+void World::setTickThreads(unsigned threads) {
+    mTickThreads = threads;
+    mPool.reset();
+}
+
+void World::setSimulationLod(int radius, int farInterval) {
+    mSimRadius = radius > 0 ? radius : 0;
+    mSimFarInterval = farInterval > 0 ? farInterval : 1;
+}
+
+// Accounts for the turns an actor sat out beyond the simulation radius. They
+// are not replayed; the actor just ages by the number of turns it would
+// probably have acted on, so the result only depends on how long it waited.
+void World::catchUpActor(Actor *actor) {
+    unsigned skipped = turn - actor->ageTurn - 1;
+    actor->ageTurn = turn;
+    if (skipped == 0 || skipped > turn) return;
+    actor->age += static_cast<int>((static_cast<unsigned long long>(skipped) * actor->def.moveChance + 500) / 1000);
+    touchActor(actor);
+}
+
+// Decides what an actor will do this turn. Runs on worker threads, so it
+// must only read the world and draw from the given generator.
+ActorIntent World::planTurn(const Actor *actor, Random &rng) const {
+    ActorIntent intent{INTENT_AGE, Dir::None, nowhere, 0};
+    if (rng.next32() % 1000 >= static_cast<unsigned>(actor->def.moveChance)) {
+        intent.type = INTENT_IDLE;
+        return intent;
+    }
+
+    if (actor->def.type == TYPE_VILLAGER) {
+        intent.type = INTENT_MOVE;
+        intent.dir = static_cast<Dir>(rng.next32() % 8);
+
+    } else if (actor->def.type == TYPE_MONSTER) {
+        Point victimPos = findActorNearest(actor->pos, actor->faction, 8);
+        if (valid(victimPos)) {
+            if (victimPos.distance(actor->pos) < 2) {
+                intent.type = INTENT_ATTACK;
+                intent.target = victimPos;
+                intent.victim = at(victimPos).actor->handle;
             } else {
-                iter = mActors.erase(iter);
-                delete actor;
+                intent.type = INTENT_MOVE;
+                intent.dir = actor->pos.directionTo(victimPos);
             }
         } else {
-            ++iter;
+            intent.type = INTENT_MOVE;
+            intent.dir = static_cast<Dir>(rng.next32() % 8);
         }
-    }
 
-    if (selection >= mPlayer->inventory.size()) {
-        selection = mPlayer->inventory.size() - 1;
+    } else if (actor->def.type == TYPE_ANIMAL) {
+        if (actor->def.foodItem >= 0) {
+            Point foodPos = findItemNearest(actor->pos, actor->def.foodItem, 8);
+            if (valid(foodPos)) {
+                Dir d = actor->pos.directionTo(foodPos);
+                if (d == Dir::None) {
+                    intent.type = INTENT_EAT;
+                    intent.target = foodPos;
+                } else {
+                    intent.type = INTENT_MOVE;
+                    intent.dir = d;
+                }
+                return intent;
+            }
+        }
+        intent.type = INTENT_MOVE;
+        intent.dir = static_cast<Dir>(rng.next32() % 8);
+
+    } else if (actor->def.type == TYPE_PLANT) {
+        // age is only increased once the turn is applied
+        if (actor->def.growTo >= 0 && actor->age + 1 >= actor->def.growTime) {
+            intent.type = INTENT_GROW;
+        }
     }
-    if (selection < 0) selection = 0;
+    return intent;
+}
 
-    auto tickEnd = std::chrono::high_resolution_clock::now();
-    tickTime = std::chrono::duration_cast<std::chrono::microseconds>(tickEnd - tickStart).count();
+// Carries out a planned turn against the world as it is now. Earlier actors
+// in the list have already moved, so moves re-check their destination,
+// attacks only land on the planned victim if it is still alive, hostile and
+// adjacent, and meals only happen if the food is still there.
+void World::applyTurn(Actor *actor, const ActorIntent &intent) {
+    if (intent.type == INTENT_IDLE) return;
+    // killed earlier this tick
+    if (actor->dead) return;
 
+    ++actor->age;
+    touchActor(actor);
+    switch (intent.type) {
+        case INTENT_MOVE:
+            tryMoveActor(actor, intent.dir);
+            break;
+        case INTENT_ATTACK: {
+            Actor *victim = getActor(intent.victim);
+            // the same test findActorNearest used when planning
+            if (!victim || victim->dead || (actor->faction >= 0 && victim->faction == actor->faction)) break;
+            if (victim->pos.distance(actor->pos) < 2) doDamage(actor, victim);
+            break; }
+        case INTENT_EAT: {
+            ItemStack food = at(intent.target).item;
+            if (!food.empty() && food.ident == actor->def.foodItem) {
+                takeItems(intent.target, 1);
+            }
+            break; }
+        case INTENT_GROW:
+            growActor(actor);
+            break;
+    }
 }
 
 void World::getTime(int *day, int *hour, int *minute) const {
@@ -771,228 +1361,861 @@ void World::getTime(int *day, int *hour, int *minute) const {
     *minute = this->minute;
 }
 
-void writeString(PHYSFS_file *out, const std::string &s) {
-    for (char c : s) {
-        PHYSFS_writeBytes(out, &c, 1);
+// section tags; each is its name in ASCII, read as a little-endian word
+const unsigned TAG_TILE     = 0x454C4954;
+const unsigned TAG_ITEM     = 0x4D455449;
+const unsigned TAG_ACTOR    = 0x52544341;
+const unsigned TAG_ROOM     = 0x4D4F4F52;
+const unsigned TAG_LOG      = 0x00474F4C;
+const unsigned TAG_CHUNK    = 0x4B4E4843;
+// starts each change record appended after the full save
+const unsigned TAG_DELTA    = 0x41544C44;
+
+void World::touchActor(Actor *actor) {
+    if (!mTrackChanges || !actor || actor->changed) return;
+    actor->changed = true;
+    mChangedActors.push_back(actor->handle);
+}
+
+// Marks everything as saved. Only the touched actors need their saved
+// position updated after a change record; a full save or load sets it for
+// every actor.
+void World::clearChanges(bool allActors) {
+    for (unsigned index : mChangedChunks) mChunkChanges[index] = 0;
+    mChangedChunks.clear();
+    if (allActors) mTrackChanges = true;
+    auto markSaved = [](Actor *actor) {
+        actor->changed = false;
+        actor->savedPos = actor->dead ? nowhere : actor->pos;
+    };
+    if (allActors) {
+        for (Actor *actor : mActors) markSaved(actor);
+    } else {
+        for (unsigned handle : mChangedActors) {
+            Actor *actor = getActor(handle);
+            if (actor) markSaved(actor);
+        }
     }
-    char zero  =0;
-    PHYSFS_writeBytes(out, &zero, 1);
+    mChangedActors.clear();
+    mRemovedActors.clear();
 }
 
-bool World::savegame(const std::string &filename) const {
-    logger_log("savegame (info): saving game.");
-    PHYSFS_file *out = PHYSFS_openWrite(filename.c_str());
-    if (!out) {
-        logger_log("savegame: Failed to open save file.");
+bool World::savegame(const std::string &filename, bool compact) {
+    // a change record must go after the one still being written
+    finishAutosave(true);
+    PendingSave save;
+    snapshotSave(save, filename, compact);
+    save.written = save.write();
+    return finishSave(save);
+}
+
+bool World::autosave(const std::string &filename) {
+    if (mAutosave) {
+        addLogMsg("Autosave skipped; the last one is still being written.");
         return false;
     }
+    auto start = std::chrono::steady_clock::now();
+    mAutosave.reset(new PendingSave);
+    snapshotSave(*mAutosave, filename, false);
+    auto end = std::chrono::steady_clock::now();
+    mAutosaveSnapshotTime = std::chrono::duration<double, std::milli>(end - start).count();
+    logger_log("autosave (info): snapshot took " + std::to_string(mAutosaveSnapshotTime) + " ms.");
+
+    PendingSave *save = mAutosave.get();
+    mAutosaveDone = false;
+    mAutosaveThread = std::thread([this, save]() {
+        save->written = save->write();
+        mAutosaveDone = true;
+    });
+    return true;
+}
 
-    const unsigned versionNumber = (VER_MAJOR << 16) | VER_MINOR;
-    PHYSFS_writeULE32(out, 0x4C5243); // magic number
-    PHYSFS_writeULE32(out, versionNumber);
-    PHYSFS_writeULE32(out, mWidth);
-    PHYSFS_writeULE32(out, mHeight);
-
-    PHYSFS_writeULE32(out, turn);
-    PHYSFS_writeULE32(out, day);
-    PHYSFS_writeULE32(out, hour);
-    PHYSFS_writeULE32(out, minute);
-
-
-    int itemCount = 0;
-    // write tiles
-    PHYSFS_writeULE32(out, 0x454C4954);
-    for (int i = 0; i < mWidth * mHeight; ++i) {
-        PHYSFS_writeULE32(out, mTiles[i].terrain);
-        PHYSFS_writeULE32(out, mTiles[i].building);
-        if (mTiles[i].item) ++itemCount;
-    }
-    // write items on ground
-    PHYSFS_writeULE32(out, 0x4D455449);
-    PHYSFS_writeULE32(out, itemCount);
-    for (int i = 0; i < mWidth * mHeight; ++i) {
-        if (!mTiles[i].item) continue;
-        const Item *item = mTiles[i].item;
-        PHYSFS_writeULE32(out, item->def.ident);
-        PHYSFS_writeULE32(out, item->pos.x);
-        PHYSFS_writeULE32(out, item->pos.y);
+void World::finishAutosave(bool wait) {
+    if (!mAutosave || (!wait && !mAutosaveDone)) return;
+    mAutosaveThread.join();
+    if (finishSave(*mAutosave)) logger_log("autosave (info): game saved.");
+    else                        addLogMsg("Autosave failed.");
+    mAutosave.reset();
+}
+
+// Builds either a full save or a change record to append, and marks the
+// world as saved. Nothing is written until save.write is called.
+void World::snapshotSave(PendingSave &save, const std::string &filename, bool compact) {
+    const bool appendable = !compact && filename == mSaveFile
+                         && mSaveDeltas < SAVE_MAX_DELTAS && mSaveDeltaSize < mSaveBaseSize / 2;
+    save.filename = filename;
+    save.compress = mCompressSaves;
+    save.append = appendable;
+    save.written = false;
+    // the save covers everything journaled so far
+    mJournalTail->data().clear();
+    if (appendable) snapshotChanges(save);
+    else            snapshotFull(save);
+}
+
+// Updates what is known about the file once a save has been written. The
+// changes it held are already marked as saved, so after a failure the
+// next save has to start the file again.
+bool World::finishSave(const PendingSave &save) {
+    if (!save.written) {
+        if (save.append)    logger_log("savegame: Failed to append to save file.");
+        else                logger_log("savegame: Failed to write save file.");
+        mSaveFile.clear();
+        return false;
     }
-    // write actors
-    PHYSFS_writeULE32(out, 0x52544341);
-    PHYSFS_writeULE32(out, mActors.size());
-    for (const Actor *actor : mActors) {
-        PHYSFS_writeULE32(out, actor->def.ident);
-        PHYSFS_writeULE32(out, actor->pos.x);
-        PHYSFS_writeULE32(out, actor->pos.y);
-        PHYSFS_writeULE32(out, actor->age);
-        PHYSFS_writeULE32(out, actor->health);
-        PHYSFS_writeULE32(out, actor->inventory.size());
-        for (const InventoryRow &row : actor->inventory.mContents) {
-            PHYSFS_writeULE32(out, row.qty);
-            PHYSFS_writeULE32(out, row.def->ident);
-        }
+    if (save.append) {
+        ++mSaveDeltas;
+        mSaveDeltaSize += save.out.size();
+    } else {
+        mSaveFile = save.filename;
+        mSaveDeltas = 0;
+        mSaveBaseSize = save.out.size();
+        mSaveDeltaSize = 0;
     }
-    // write rooms
-    PHYSFS_writeULE32(out, 0x4D4F4F52);
-    PHYSFS_writeULE32(out, mRooms.size());
-    for (const Room *room : mRooms) {
-        PHYSFS_writeULE32(out, room->type);
-        unsigned char size = room->points.size();
-        PHYSFS_writeBytes(out, &size, 1);
-        for (const Point &p : room->points) {
-            PHYSFS_writeULE32(out, p.x);
-            PHYSFS_writeULE32(out, p.y);
+    restartJournal();
+    return true;
+}
+
+const unsigned JOURNAL_MAGIC = 0x4C4E524A;
+
+// the journal for game.sav is game.jnl
+static std::string journalName(const std::string &saveFile) {
+    const std::string ext = ".sav";
+    if (saveFile.size() > ext.size() && saveFile.compare(saveFile.size() - ext.size(), ext.size(), ext) == 0) {
+        return saveFile.substr(0, saveFile.size() - ext.size()) + ".jnl";
+    }
+    return saveFile + ".jnl";
+}
+
+// The journal starts with the size of the save it follows, which is enough
+// to tell it from the journal of any other save made to the same file.
+static void writeJournalHeader(SaveWriter &out, unsigned saveSize) {
+    const unsigned versionNumber = (VER_MAJOR << 16) | (VER_MINOR << 8) | SAVE_VERSION;
+    out.write32(JOURNAL_MAGIC);
+    out.write32(versionNumber);
+    out.write32(saveSize);
+}
+
+static void writeJournalEntry(SaveWriter &out, const JournalEntry &entry) {
+    out.write32(entry.turn);
+    out.write64(entry.random[0]);
+    out.write64(entry.random[1]);
+    out.write16(entry.command);
+    out.write32(entry.selection);
+    out.write8(static_cast<unsigned char>(entry.dir));
+    out.write8(entry.answers.size());
+    for (Dir answer : entry.answers) {
+        out.write8(static_cast<unsigned char>(answer));
+    }
+}
+
+static bool readJournalEntry(SaveReader &in, JournalEntry &entry) {
+    entry.turn = in.read32();
+    entry.random[0] = in.read64();
+    entry.random[1] = in.read64();
+    entry.command = in.read16();
+    entry.selection = in.read32();
+    int dir = in.read8();
+    entry.dir = static_cast<Dir>(dir);
+    int answerCount = in.read8();
+    entry.answers.clear();
+    for (int i = 0; i < answerCount && !in.failed(); ++i) {
+        int answer = in.read8();
+        if (answer > static_cast<int>(Dir::None)) return false;
+        entry.answers.push_back(static_cast<Dir>(answer));
+    }
+    return !in.failed() && dir <= static_cast<int>(Dir::None);
+}
+
+// Starts the journal over once a save is written, keeping the entries made
+// while it was being written.
+void World::restartJournal() {
+    mJournalFile = journalName(mSaveFile);
+    SaveWriter journal;
+    writeJournalHeader(journal, mSaveBaseSize + mSaveDeltaSize);
+    journal.writeBytes(mJournalTail->data().data(), mJournalTail->size());
+    mJournal->restart(mJournalFile, journal);
+    mJournalBatch->data().clear();
+}
+
+// Picks up the journal of a save that was just loaded, keeping every whole
+// entry if it belongs to that save and starting it over if not.
+void World::openJournal(const std::string &saveFile, unsigned saveSize) {
+    mJournalFile = journalName(saveFile);
+    mJournalTail->data().clear();
+    mJournalBatch->data().clear();
+    SaveReader in;
+    const unsigned versionNumber = (VER_MAJOR << 16) | (VER_MINOR << 8) | SAVE_VERSION;
+    if (in.readFile("/save/" + mJournalFile) && in.read32() == static_cast<int>(JOURNAL_MAGIC)
+            && in.read32() == static_cast<int>(versionNumber)
+            && in.read32() == static_cast<int>(saveSize)) {
+        const std::size_t start = in.size() - in.remaining();
+        std::size_t end = start;
+        JournalEntry entry;
+        // the game may have stopped part way through writing the last one
+        while (in.remaining() > 0 && readJournalEntry(in, entry)) {
+            end = in.size() - in.remaining();
         }
+        mJournalTail->writeBytes(in.data() + start, end - start);
     }
-    // write log
-    PHYSFS_writeULE32(out, 0x00474F4C);
-    PHYSFS_writeULE32(out, mLog.size());
-    for (const LogMessage &msg : mLog) {
-        writeString(out, msg.msg);
+    SaveWriter journal;
+    writeJournalHeader(journal, saveSize);
+    journal.writeBytes(mJournalTail->data().data(), mJournalTail->size());
+    mJournal->restart(mJournalFile, journal);
+}
+
+JournalEntry World::startJournalEntry(const Command &command) {
+    JournalEntry entry;
+    entry.turn = turn;
+    mRandom.getState(entry.random[0], entry.random[1]);
+    entry.command = command.command;
+    entry.selection = selection;
+    entry.dir = command.dir;
+    // left over from a command that was not journaled
+    mJournalAnswers.clear();
+    return entry;
+}
+
+void World::journalCommand(JournalEntry entry) {
+    if (mReplaying) return;
+    entry.answers.swap(mJournalAnswers);
+    mJournalAnswers.clear();
+    // until there is a save to follow, there is nothing to journal against
+    if (mJournalFile.empty() && !mAutosave) return;
+    writeJournalEntry(*mJournalTail, entry);
+    writeJournalEntry(*mJournalBatch, entry);
+}
+
+void World::flushJournal() {
+    if (mJournal->takeFailure()) addLogMsg("Writing the journal failed.");
+    if (mJournalFile.empty() || mJournalBatch->size() == 0) return;
+    mJournal->append(mJournalFile, *mJournalBatch);
+    mJournalBatch->data().clear();
+}
+
+bool World::readJournal(std::vector<JournalEntry> &entries) const {
+    entries.clear();
+    SaveReader in(mJournalTail->data().data(), mJournalTail->size());
+    JournalEntry entry;
+    while (in.remaining() > 0 && readJournalEntry(in, entry)) {
+        entries.push_back(entry);
     }
+    return !entries.empty();
+}
 
-    PHYSFS_close(out);
-    return true;
+bool World::takeJournalGap() {
+    bool gap = mJournalGap;
+    mJournalGap = false;
+    return gap;
+}
+
+void World::journalAnswer(Dir dir) {
+    if (!mReplaying) mJournalAnswers.push_back(dir);
 }
 
-char read8(PHYSFS_File *file) {
-    char v;
-    if (PHYSFS_readBytes(file, &v, 1) != 1) {
-        return -1;
+bool World::replayAnswer(Dir &dir) {
+    if (!mReplaying) return false;
+    // answers are held last first
+    dir = Dir::None;
+    if (!mJournalAnswers.empty()) {
+        dir = mJournalAnswers.back();
+        mJournalAnswers.pop_back();
     }
-    return v;
+    return true;
+}
+
+void World::beginReplay(const JournalEntry &entry) {
+    mReplaying = true;
+    mRandom.setState(entry.random[0], entry.random[1]);
+    selection = entry.selection;
+    mJournalAnswers.assign(entry.answers.rbegin(), entry.answers.rend());
 }
-int read32(PHYSFS_File *file) {
-    unsigned v;
-    if (!PHYSFS_readULE32(file, &v)) {
-        return -1;
+
+void World::endReplay() {
+    mReplaying = false;
+    mJournalAnswers.clear();
+}
+
+// Writes the stacks in one chunk in row order, adding them to count.
+void World::writeChunkItems(SaveWriter &out, unsigned index, unsigned &count) const {
+    const ChunkPlane<ItemStack> &plane = mChunks[index].item;
+    if (plane.uniform() && plane.get(0).empty()) return;
+    const Point corner = chunkCorner(index);
+    for (int c = 0; c < CHUNK_AREA; ++c) {
+        ItemStack stack = plane.get(c);
+        if (stack.empty()) continue;
+        out.write32(stack.ident);
+        out.write32(corner.x + (c & CHUNK_MASK));
+        out.write32(corner.y + (c >> CHUNK_SHIFT));
+        out.write32(stack.qty);
+        ++count;
     }
-    return v;
 }
-std::string readString(PHYSFS_File *file) {
-    std::string s;
-    char c = read8(file);
-    while (c != 0) {
-        s += c;
-        c = read8(file);
+
+void World::writeActor(SaveWriter &out, const Actor *actor) const {
+    out.write32(actor->def.ident);
+    out.write32(actor->pos.x);
+    out.write32(actor->pos.y);
+    out.write32(getActorAge(actor));
+    out.write32(actor->health);
+    out.write32(actor->inventory.size());
+    for (const InventoryRow &row : actor->inventory.mContents) {
+        out.write32(row.qty);
+        out.write32(row.def->ident);
     }
-    return s;
 }
 
-bool World::loadgame(const std::string &filename) {
-    logger_log("loadgame (info): loading game.");
-    PHYSFS_file *inf = PHYSFS_openRead(("/save/" + filename).c_str());
-    if (!inf) {
-        logger_log("loadgame: Failed to open save file.");
-        return false;
+void World::writeRooms(SaveWriter &out) const {
+    out.write32(mRooms.size());
+    for (const Room *room : mRooms) {
+        out.write32(room->type);
+        const TileMask &tiles = room->tiles;
+        out.write32(tiles.origin().x);
+        out.write32(tiles.origin().y);
+        out.write32(tiles.width());
+        out.write32(tiles.height());
+        out.write32s(tiles.words().data(), tiles.words().size());
     }
+}
 
-    if (read32(inf) != 0x4C5243) {
-        logger_log("loadgame: bad magic number.");
-        PHYSFS_close(inf);
-        return false;
+void World::writeLog(SaveWriter &out) const {
+    out.write32(mLog.size());
+    for (const LogMessage &msg : mLog) {
+        out.writeString(msg.msg);
     }
+}
 
-    const unsigned versionNumber = (VER_MAJOR << 16) | VER_MINOR;
-    if (read32(inf) != versionNumber) {
-        logger_log("loadgame: incompatable save version.");
-        PHYSFS_close(inf);
+void World::snapshotFull(PendingSave &save) {
+    logger_log("savegame (info): saving game.");
+    SaveWriter &out = save.out;
+    const unsigned versionNumber = (VER_MAJOR << 16) | (VER_MINOR << 8) | SAVE_VERSION;
+    out.write32(0x4C5243); // magic number
+    out.write32(versionNumber);
+    out.write32(mWidth);
+    out.write32(mHeight);
+
+    out.write32(turn);
+    out.write32(day);
+    out.write32(hour);
+    out.write32(minute);
+
+    std::vector<SaveSection> &sections = save.sections;
+    // write tiles, one whole chunk plane at a time; compressed saves store
+    // them as runs since most chunks are a handful of long runs
+    sections.push_back(SaveSection{TAG_TILE, mCompressSaves ? SECTION_RUNS : 0});
+    SaveWriter *section = &sections.back().data;
+    short cells[CHUNK_AREA];
+    for (const MapChunk &chunk : mChunks) {
+        chunk.terrain.copyTo(cells);
+        if (mCompressSaves) section->writeRuns16(cells, CHUNK_AREA);
+        else                section->write16s(cells, CHUNK_AREA);
+        chunk.building.copyTo(cells);
+        if (mCompressSaves) section->writeRuns16(cells, CHUNK_AREA);
+        else                section->write16s(cells, CHUNK_AREA);
+    }
+    // write items on ground; the count is filled in once they are written
+    sections.push_back(SaveSection{TAG_ITEM, 0});
+    section = &sections.back().data;
+    section->write32(0);
+    unsigned itemCount = 0;
+    for (unsigned i = 0; i < mChunks.size(); ++i) {
+        writeChunkItems(*section, i, itemCount);
+    }
+    section->patch32(0, itemCount);
+    // write actors
+    sections.push_back(SaveSection{TAG_ACTOR, 0});
+    section = &sections.back().data;
+    // actors removed since the last tick are not purged yet, so skip them
+    unsigned liveActors = 0;
+    for (const Actor *actor : mActors) {
+        if (!actor->dead) ++liveActors;
+    }
+    section->write32(liveActors);
+    for (const Actor *actor : mActors) {
+        if (!actor->dead) writeActor(*section, actor);
+    }
+    sections.push_back(SaveSection{TAG_ROOM, 0});
+    writeRooms(sections.back().data);
+    sections.push_back(SaveSection{TAG_LOG, 0});
+    writeLog(sections.back().data);
+    clearChanges(true);
+}
+
+// Builds a record of what changed since the last save. Tiles are only
+// written for chunks whose tiles changed and items for chunks whose items
+// did. Actors are written one by one, keyed by where the last save put
+// them. Rooms and the log are small, so they go in whole.
+void World::snapshotChanges(PendingSave &save) {
+    logger_log("savegame (info): saving changes.");
+    // the player's inventory changes without the world seeing it
+    touchActor(mPlayer);
+
+    SaveWriter &out = save.out;
+    out.write32(TAG_DELTA);
+    out.write32(0);     // size of the rest of the record
+    out.write32(turn);
+    out.write32(day);
+    out.write32(hour);
+    out.write32(minute);
+
+    std::vector<SaveSection> &sections = save.sections;
+    sections = {
+        { TAG_TILE, mCompressSaves ? SECTION_RUNS : 0 },
+        { TAG_CHUNK, 0 }, { TAG_ITEM, 0 }, { TAG_ACTOR, 0 }, { TAG_ROOM, 0 }, { TAG_LOG, 0 }
+    };
+    SaveWriter &tiles = sections[0].data;
+    SaveWriter &chunks = sections[1].data;
+    SaveWriter &items = sections[2].data;
+    SaveWriter &actors = sections[3].data;
+    tiles.write32(0);
+    chunks.write32(0);
+    items.write32(0);
+
+    unsigned tileCount = 0, chunkCount = 0, itemCount = 0;
+    short cells[CHUNK_AREA];
+    for (unsigned index : mChangedChunks) {
+        const MapChunk &chunk = mChunks[index];
+        if (mChunkChanges[index] & CHANGED_TILES) {
+            tiles.write32(index);
+            chunk.terrain.copyTo(cells);
+            if (mCompressSaves) tiles.writeRuns16(cells, CHUNK_AREA);
+            else                tiles.write16s(cells, CHUNK_AREA);
+            chunk.building.copyTo(cells);
+            if (mCompressSaves) tiles.writeRuns16(cells, CHUNK_AREA);
+            else                tiles.write16s(cells, CHUNK_AREA);
+            ++tileCount;
+        }
+        if (mChunkChanges[index] & CHANGED_ITEMS) {
+            chunks.write32(index);
+            ++chunkCount;
+            writeChunkItems(items, index, itemCount);
+        }
+    }
+    tiles.patch32(0, tileCount);
+    chunks.patch32(0, chunkCount);
+    items.patch32(0, itemCount);
+
+    // actors removed since the last tick are not purged yet, so count them
+    // as removed here and make sure the purge does not do so again
+    for (Actor *actor : mDeadActors) {
+        if (!valid(actor->savedPos)) continue;
+        mRemovedActors.push_back(actor->savedPos);
+        actor->savedPos = nowhere;
+    }
+    actors.write32(mRemovedActors.size());
+    for (const Point &pos : mRemovedActors) {
+        actors.write32(pos.x);
+        actors.write32(pos.y);
+    }
+    const std::size_t countAt = actors.size();
+    actors.write32(0);
+    unsigned actorCount = 0;
+    for (unsigned handle : mChangedActors) {
+        const Actor *actor = getActor(handle);
+        if (!actor || actor->dead) continue;
+        actors.write32(actor->savedPos.x);
+        actors.write32(actor->savedPos.y);
+        writeActor(actors, actor);
+        ++actorCount;
+    }
+    actors.patch32(countAt, actorCount);
+    writeRooms(sections[4].data);
+    writeLog(sections[5].data);
+    clearChanges(false);
+}
+
+// Opens one section of the save file for reading.
+static bool loadSection(const SaveReader &file, const std::vector<SaveSectionEntry> &table,
+                        unsigned tag, const std::string &name, SaveReader &section,
+                        unsigned *encoding = nullptr) {
+    if (!openSection(file, table, tag, section, encoding)) {
+        logger_log("loadgame: missing or corrupt " + name + " data.");
         return false;
     }
-    int width = read32(inf);
-    int height = read32(inf);
-    allocMap(width, height);
-
-    turn    = read32(inf);
-    day     = read32(inf);
-    hour    = read32(inf);
-    minute  = read32(inf);
+    return true;
+}
 
-    // read tiles
-    if (read32(inf) != 0x454C4954) {
-        logger_log("loadgame: expected start of tile data.");
-        PHYSFS_close(inf);
+// Checks a section was read without running off its end.
+static bool finishSection(const SaveReader &section, const std::string &name) {
+    if (section.failed()) {
+        logger_log("loadgame: " + name + " data is truncated.");
         return false;
     }
-    for (int i = 0; i < mWidth * mHeight; ++i) {
-        int t = read32(inf);
-        mTiles[i].terrain = t;
-        t = read32(inf);
-        mTiles[i].building = t;
-    }
+    return true;
+}
 
-    // read items on ground
-    if (read32(inf) != 0x4D455449) {
-        logger_log("loadgame: expected start of item data.");
-        PHYSFS_close(inf);
-        return false;
+// Reads a chunk's terrain and building planes straight into the chunk.
+static void readChunkTiles(SaveReader &section, unsigned encoding, MapChunk &chunk) {
+    if (encoding & SECTION_RUNS) {
+        section.readRuns16(chunk.terrain.rawCells(), CHUNK_AREA);
+        section.readRuns16(chunk.building.rawCells(), CHUNK_AREA);
+    } else {
+        section.read16s(chunk.terrain.rawCells(), CHUNK_AREA);
+        section.read16s(chunk.building.rawCells(), CHUNK_AREA);
     }
-    int itemCount = read32(inf);
+}
+
+bool World::readItems(SaveReader &in) {
+    int itemCount = in.read32();
     for (int i = 0; i < itemCount; ++i) {
-        int ident = read32(inf);
-        Item *item = new Item(getItemDef(ident));
-        int x = read32(inf);
-        int y = read32(inf);
+        int ident = in.read32();
+        int x = in.read32();
+        int y = in.read32();
+        int qty = in.read32();
         Point pos(x, y);
-        moveItem(item, pos);
+        if (qty <= 0 || qty > ITEM_STACK_MAX || getItemDef(ident).ident < 0 || !valid(pos)) {
+            logger_log("loadgame: bad item stack.");
+            return false;
+        }
+        setItems(pos, ItemStack(ident, qty));
     }
+    return finishSection(in, "item");
+}
 
-    // read actors
-    if (read32(inf) != 0x52544341) {
-        logger_log("loadgame: expected start of actor data.");
-        PHYSFS_close(inf);
-        return false;
-    }
-    int actorCount = read32(inf);
-    for (int i = 0; i < actorCount; ++i) {
-        int ident = read32(inf);
-        Actor *actor = new Actor(getActorDef(ident));
-        int x = read32(inf);
-        int y = read32(inf);
+bool World::readActors(SaveReader &in) {
+    int actorCount = in.read32();
+    for (int i = 0; i < actorCount && !in.failed(); ++i) {
+        int ident = in.read32();
+        Actor *actor = createActor(getActorDef(ident));
+        if (!actor) {
+            return false;
+        }
+        int x = in.read32();
+        int y = in.read32();
         Point pos(x, y);
+        // age is needed to schedule growth, so set it before placing
+        actor->age = in.read32();
+        actor->health = in.read32();
         moveActor(actor, pos);
-        actor->age = read32(inf);
-        actor->health = read32(inf);
-        int invCount = read32(inf);
+        int invCount = in.read32();
         for (int j = 0; j < invCount; ++j) {
-            int qty = read32(inf);
-            int itemIdent = read32(inf);
+            int qty = in.read32();
+            int itemIdent = in.read32();
             const ItemDef &idef = getItemDef(itemIdent);
             actor->inventory.add(&idef, qty);
         }
     }
-    // read rooms
-    if (read32(inf) != 0x4D4F4F52) {
-        logger_log("loadgame: expected start of room data.");
-        return false;
-    }
-    int roomCount = read32(inf);
+    return finishSection(in, "actor");
+}
+
+bool World::readRooms(SaveReader &in) {
+    int roomCount = in.read32();
     for (int i = 0; i < roomCount; ++i) {
         Room *room = new Room;
-        room->type = read32(inf);
-        int pointCount = read8(inf);
-        for (int j = 0; j < pointCount; ++j) {
-            Point p;
-            p.x = read32(inf);
-            p.y = read32(inf);
-            room->points.push_back(p);
+        room->type = in.read32();
+        Point origin;
+        origin.x = in.read32();
+        origin.y = in.read32();
+        int roomWidth = in.read32();
+        int roomHeight = in.read32();
+        // sides are checked before anything is added or multiplied, so a
+        // corrupt save can't overflow its way past the area check
+        if (roomWidth <= 0 || roomHeight <= 0
+                || roomWidth > mWidth || roomHeight > mHeight
+                || static_cast<long long>(roomWidth) * roomHeight > ROOM_MAX_AREA
+                || !valid(origin)
+                || !valid(Point(origin.x + roomWidth - 1, origin.y + roomHeight - 1))) {
+            logger_log("loadgame: bad room bounds.");
+            delete room;
+            return false;
+        }
+        room->tiles.reset(origin, roomWidth, roomHeight);
+        for (unsigned j = 0; j < room->tiles.words().size(); ++j) {
+            room->tiles.setWord(j, in.read32());
         }
         addRoom(room);
         updateRoom(room);
     }
-    // read log
-    if (read32(inf) != 0x00474F4C) {
-        logger_log("loadgame: expected start of log data.");
-        PHYSFS_close(inf);
+    return finishSection(in, "room");
+}
+
+void World::readLog(SaveReader &in) {
+    int logCount = in.read32();
+    for (int i = 0; i < logCount && !in.failed(); ++i) {
+        std::string msg = in.readString();
+        addLogMsg(msg);
+    }
+}
+
+// Removes every item in a chunk so a change record can put back what it
+// holds now.
+void World::clearChunkItems(unsigned index) {
+    const ChunkPlane<ItemStack> &plane = mChunks[index].item;
+    if (plane.uniform() && plane.get(0).empty()) return;
+    const Point corner = chunkCorner(index);
+    for (int c = 0; c < CHUNK_AREA; ++c) {
+        Point pos(corner.x + (c & CHUNK_MASK), corner.y + (c >> CHUNK_SHIFT));
+        if (valid(pos) && !plane.get(c).empty()) setItems(pos, ItemStack());
+    }
+}
+
+// Applies the actor part of a change record. Every actor named by where it
+// was saved is lifted off the map before any are put back, since one may
+// have moved onto the tile another has just left.
+bool World::applyActorChanges(SaveReader &in) {
+    struct ActorChange {
+        Actor *actor;
+        int ident;
+        Point pos;
+        int age, health;
+        std::vector<std::pair<int, int> > inventory;
+    };
+    auto liftActor = [this](const Point &pos) -> Actor* {
+        Actor *actor = valid(pos) ? at(pos).actor : nullptr;
+        if (actor) setActor(pos, nullptr);
+        return actor;
+    };
+
+    int removedCount = in.read32();
+    for (int i = 0; i < removedCount && !in.failed(); ++i) {
+        int x = in.read32();
+        int y = in.read32();
+        Actor *actor = liftActor(Point(x, y));
+        if (!actor) {
+            logger_log("loadgame: removed actor is missing.");
+            return false;
+        }
+        actor->dead = true;
+        mDeadActors.push_back(actor);
+    }
+
+    std::vector<ActorChange> changes;
+    int changedCount = in.read32();
+    for (int i = 0; i < changedCount && !in.failed(); ++i) {
+        ActorChange change;
+        int savedX = in.read32();
+        int savedY = in.read32();
+        change.ident = in.read32();
+        change.pos.x = in.read32();
+        change.pos.y = in.read32();
+        change.age = in.read32();
+        change.health = in.read32();
+        int invCount = in.read32();
+        for (int j = 0; j < invCount && !in.failed(); ++j) {
+            int qty = in.read32();
+            int itemIdent = in.read32();
+            change.inventory.push_back(std::make_pair(qty, itemIdent));
+        }
+        change.actor = nullptr;
+        if (savedX >= 0) {
+            change.actor = liftActor(Point(savedX, savedY));
+            if (!change.actor || change.actor->def.ident != change.ident) {
+                logger_log("loadgame: changed actor is missing.");
+                return false;
+            }
+        }
+        changes.push_back(change);
+    }
+    if (!finishSection(in, "actor")) return false;
+
+    for (ActorChange &change : changes) {
+        Actor *actor = change.actor;
+        if (!valid(change.pos) || at(change.pos).actor) {
+            logger_log("loadgame: bad actor position.");
+            return false;
+        }
+        if (!actor) {
+            actor = createActor(getActorDef(change.ident));
+            if (!actor) return false;
+        }
+        actor->age = change.age;
+        actor->health = change.health;
+        actor->inventory.mContents.clear();
+        for (const std::pair<int, int> &row : change.inventory) {
+            actor->inventory.add(&getItemDef(row.second), row.first);
+        }
+        if (change.actor) {
+            // still listed, so it only needs to go back on the map
+            setActor(change.pos, actor);
+            actor->pos = change.pos;
+            actor->ageTurn = turn;
+            if (actor->type == 1) mPlayer = actor;
+        } else {
+            moveActor(actor, change.pos);
+        }
+    }
+
+    auto isDead = [](const Actor *actor) { return actor->dead; };
+    mActors.erase(std::remove_if(mActors.begin(), mActors.end(), isDead), mActors.end());
+    mActive.erase(std::remove_if(mActive.begin(), mActive.end(), isDead), mActive.end());
+    for (Actor *actor : mDeadActors) {
+        if (actor == mPlayer) mPlayer = nullptr;
+        destroyActor(actor);
+    }
+    mDeadActors.clear();
+    return true;
+}
+
+// Applies one change record on top of the world loaded so far.
+bool World::applyChanges(SaveReader &record) {
+    record.read32();    // tag and size, already checked
+    record.read32();
+    turn    = record.read32();
+    day     = record.read32();
+    hour    = record.read32();
+    minute  = record.read32();
+    std::vector<SaveSectionEntry> table;
+    if (!readSectionTable(record, table)) {
+        logger_log("loadgame: bad section table in change record.");
         return false;
     }
-    int logCount = read32(inf);
-    for (int i = 0; i < logCount; ++i) {
-        std::string msg = readString(inf);
-        addLogMsg(msg);
+
+    SaveReader section;
+    unsigned encoding = 0;
+    if (!loadSection(record, table, TAG_TILE, "changed tile", section, &encoding)) return false;
+    int tileCount = section.read32();
+    for (int i = 0; i < tileCount && !section.failed(); ++i) {
+        unsigned index = section.read32();
+        if (index >= mChunks.size()) {
+            logger_log("loadgame: bad chunk in change record.");
+            return false;
+        }
+        readChunkTiles(section, encoding, mChunks[index]);
+    }
+    if (!finishSection(section, "changed tile")) return false;
+
+    if (!loadSection(record, table, TAG_CHUNK, "changed chunk", section)) return false;
+    int chunkCount = section.read32();
+    for (int i = 0; i < chunkCount && !section.failed(); ++i) {
+        unsigned index = section.read32();
+        if (index >= mChunks.size()) {
+            logger_log("loadgame: bad chunk in change record.");
+            return false;
+        }
+        clearChunkItems(index);
+    }
+    if (!finishSection(section, "changed chunk")) return false;
+
+    if (!loadSection(record, table, TAG_ITEM, "item", section)) return false;
+    if (!readItems(section)) return false;
+    if (!loadSection(record, table, TAG_ACTOR, "actor", section)) return false;
+    if (!applyActorChanges(section)) return false;
+
+    while (!mRooms.empty()) {
+        Room *room = mRooms.back();
+        removeRoom(room);
+        delete room;
+    }
+    if (!loadSection(record, table, TAG_ROOM, "room", section)) return false;
+    if (!readRooms(section)) return false;
+    mLog.clear();
+    if (!loadSection(record, table, TAG_LOG, "log", section)) return false;
+    readLog(section);
+    return finishSection(section, "log");
+}
+
+bool World::loadgame(const std::string &filename) {
+    logger_log("loadgame (info): loading game.");
+    finishAutosave(true);
+    SaveReader inf;
+    if (!inf.readFile("/save/" + filename)) {
+        logger_log("loadgame: Failed to read save file.");
+        return false;
+    }
+
+    if (inf.read32() != 0x4C5243) {
+        logger_log("loadgame: bad magic number.");
+        return false;
+    }
+
+    const unsigned versionNumber = (VER_MAJOR << 16) | (VER_MINOR << 8) | SAVE_VERSION;
+    if (inf.read32() != static_cast<int>(versionNumber)) {
+        logger_log("loadgame: incompatable save version.");
+        return false;
+    }
+    int width = inf.read32();
+    int height = inf.read32();
+    if (width <= 0 || height <= 0) {
+        logger_log("loadgame: bad map size.");
+        return false;
+    }
+    const int newTurn = inf.read32();
+    const int newDay = inf.read32();
+    const int newHour = inf.read32();
+    const int newMinute = inf.read32();
+    std::vector<SaveSectionEntry> table;
+    if (!readSectionTable(inf, table)) {
+        logger_log("loadgame: bad section table.");
+        return false;
+    }
+
+    // read tiles
+    SaveReader section;
+    unsigned encoding = 0;
+    if (!loadSection(inf, table, TAG_TILE, "tile", section, &encoding)) return false;
+    // each chunk stores two planes of 16-bit tiles
+    const long long chunkCount = static_cast<long long>((width + CHUNK_MASK) >> CHUNK_SHIFT)
+                               * ((height + CHUNK_MASK) >> CHUNK_SHIFT);
+    if (!(encoding & SECTION_RUNS) && chunkCount * CHUNK_AREA * 4 != static_cast<long long>(section.size())) {
+        logger_log("loadgame: tile data does not match map size.");
+        return false;
+    }
+    allocMap(width, height);
+    turn    = newTurn;
+    day     = newDay;
+    hour    = newHour;
+    minute  = newMinute;
+    mGrowth.reset(turn);
+
+    // plain planes are copied straight from the file into each chunk
+    for (MapChunk &chunk : mChunks) {
+        readChunkTiles(section, encoding, chunk);
+    }
+    if (!finishSection(section, "tile")) return false;
+
+    if (!loadSection(inf, table, TAG_ITEM, "item", section)) return false;
+    if (!readItems(section)) return false;
+    if (!loadSection(inf, table, TAG_ACTOR, "actor", section)) return false;
+    if (!readActors(section)) return false;
+    if (!loadSection(inf, table, TAG_ROOM, "room", section)) return false;
+    if (!readRooms(section)) return false;
+    if (!loadSection(inf, table, TAG_LOG, "log", section)) return false;
+    readLog(section);
+    if (!finishSection(section, "log")) return false;
+
+    // change records follow the last section of the full save
+    std::size_t pos = inf.size() - inf.remaining();
+    for (const SaveSectionEntry &entry : table) {
+        pos = std::max<std::size_t>(pos, entry.offset + entry.storedSize);
+    }
+    const std::size_t baseSize = pos;
+    unsigned deltas = 0;
+    bool complete = true;
+    while (pos < inf.size()) {
+        SaveReader header(inf.data() + pos, inf.size() - pos);
+        const int tag = header.read32();
+        const unsigned size = header.read32();
+        if (header.failed() || tag != static_cast<int>(TAG_DELTA) || size > header.remaining()) {
+            // most likely the game stopped part way through appending
+            logger_log("loadgame: ignoring incomplete change record.");
+            complete = false;
+            break;
+        }
+        SaveReader record(inf.data() + pos, size + 8);
+        if (!applyChanges(record)) return false;
+        pos += size + 8;
+        ++deltas;
+    }
+    // actors were placed on whichever turn their record was for, so bring
+    // them all onto the final turn as a full load would
+    if (deltas > 0) {
+        mGrowth.reset(turn);
+        for (Actor *actor : mActors) {
+            if (!onSchedule(actor->def)) {
+                actor->ageTurn = turn;
+            } else if (actor->def.growTo >= 0) {
+                mGrowth.schedule(growthTurn(actor), actor->handle);
+            }
+        }
     }
 
-    PHYSFS_close(inf);
+    compactMap();
+    clearChanges(true);
+    mSaveFile = complete ? filename : std::string();
+    mSaveDeltas = deltas;
+    mSaveBaseSize = baseSize;
+    mSaveDeltaSize = pos - baseSize;
+    openJournal(filename, pos);
     return true;
 }
 
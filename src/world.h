@@ -1,20 +1,59 @@
 #ifndef WORLD_H
 #define WORLD_H
 
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <functional>
 #include <iosfwd>
 #include <map>
+#include <memory>
+#include <new>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "logger.h"
 #include "random.h"
+#include "timing_wheel.h"
+#include "worker_pool.h"
 
 const unsigned VER_MAJOR             = 0;
 const unsigned VER_MINOR             = 1;
 const unsigned VER_PATCH             = 0;
+// bumped whenever the save file layout changes
+const unsigned SAVE_VERSION          = 6;
+// a save is rewritten in full once it has this many change records appended
+const unsigned SAVE_MAX_DELTAS       = 16;
 
 const int INPUT_KEY_COUNT = 3;
 
+// conditions that interrupt World::rest
+const unsigned REST_ON_HOSTILE  = 1;    // a monster is within the rest radius
+const unsigned REST_ON_DAMAGE   = 2;    // the player lost health or died
+const unsigned REST_ON_CROP     = 4;    // a plant in the radius finished growing
+
+// why World::rest stopped
+const int REST_FINISHED         = 0;
+const int REST_HOSTILE          = 1;
+const int REST_DAMAGED          = 2;
+const int REST_CROP             = 3;
+const int REST_CANCELLED        = 4;
+
+const int CHUNK_SHIFT = 5;
+const int CHUNK_SIZE  = 1 << CHUNK_SHIFT;
+const int CHUNK_MASK  = CHUNK_SIZE - 1;
+const int CHUNK_AREA  = CHUNK_SIZE * CHUNK_SIZE;
+
+// largest bounding box (in tiles) an enclosed area may have to be a room;
+// anything bigger is taken to be open ground
+const int ROOM_MAX_AREA = 64 * 64;
+// most items one ground tile can hold
+const int ITEM_STACK_MAX = 0xFFFF;
+
 const int AI_NONE = 0;
 const int AI_WANDER = 1;
 
@@ -46,6 +85,15 @@ const int TILE_COAL_VEIN        = 32;
 const int TILE_SILVER_VEIN      = 33;
 const int TILE_GOLD_VEIN        = 34;
 
+const unsigned TF_SOLID         = 0x01;
+const unsigned TF_OPAQUE        = 0x02;
+const unsigned TF_GROUND        = 0x04;
+const unsigned TF_WALL          = 0x08;
+const unsigned TF_CONNECTING    = 0x10;
+
+const int LAYER_TERRAIN         = 0;
+const int LAYER_BUILDING        = 1;
+
 const int CMD_NONE              = -1;
 const int CMD_TAKE              = 1;
 const int CMD_BREAK             = 2;
@@ -74,6 +122,7 @@ const int CMD_MAKEROOM          = 24;
 const int CMD_CLEARROOM         = 25;
 const int CMD_VIEWLOG           = 26;
 const int CMD_SORT_INV_TYPE     = 27;
+const int CMD_REST              = 28;
 
 const int LD_VERTICAL   = 0x2502;
 const int LD_HORIZONTAL = 0x2500;
@@ -180,6 +229,47 @@ struct RoomDef {
     std::vector<int> requirements;
 };
 
+// Maps definition idents onto their position in a definition list. Idents
+// are sparse (e.g. 30-34, 1000+) so this uses a dense table covering the
+// range between the lowest and highest ident.
+class DefIndex {
+public:
+    DefIndex() : mFirst(0) { }
+    template<class T>
+    bool build(const std::vector<T> &defs);
+    void clear() { mSlots.clear(); }
+    bool empty() const { return mSlots.empty(); }
+    int slot(int ident) const {
+        unsigned offset = static_cast<unsigned>(ident) - static_cast<unsigned>(mFirst);
+        if (offset >= mSlots.size()) return -1;
+        return mSlots[offset];
+    }
+
+private:
+    static const int MAX_SPAN = 1 << 20;
+    int mFirst;
+    std::vector<int> mSlots;
+};
+
+template<class T>
+bool DefIndex::build(const std::vector<T> &defs) {
+    mSlots.clear();
+    if (defs.empty()) return true;
+    int low = defs[0].ident, high = defs[0].ident;
+    for (const T &def : defs) {
+        if (def.ident < low)  low = def.ident;
+        if (def.ident > high) high = def.ident;
+    }
+    if (static_cast<long long>(high) - low >= MAX_SPAN) return false;
+    mFirst = low;
+    mSlots.resize(high - low + 1, -1);
+    for (unsigned i = 0; i < defs.size(); ++i) {
+        int &slot = mSlots[defs[i].ident - low];
+        if (slot < 0) slot = i;
+    }
+    return true;
+}
+
 struct InventoryRow {
     int qty;
     const ItemDef *def;
@@ -196,7 +286,7 @@ struct Inventory {
 };
 
 struct Actor {
-    Actor(const ActorDef &def) : type(def.ident), def(def), age(0), faction(def.defaultFaction) { }
+    Actor(const ActorDef &def) : type(def.ident), def(def), age(0), faction(def.defaultFaction), handle(0), ageTurn(0), dead(false), savedPos(-1, -1), changed(false) { }
     std::string getName() const;
     void reset();
 
@@ -208,45 +298,432 @@ struct Actor {
     int health;
     int age;
     int faction;
+    unsigned handle;
+    // turn age was last brought up to date; see World::getActorAge
+    unsigned ageTurn;
+    // off the map and waiting for World::purgeDeadActors
+    bool dead;
+    // where the last save put it, or nowhere if it is not in the save yet
+    Point savedPos;
+    // listed in World's actors to write with the next change record
+    bool changed;
 };
 
-struct Item {
-    Item(const ItemDef &def) : type(def.ident), def(def) { }
-    std::string getName(bool forPural) const;
+// A pile of identical items lying on one tile. Stacks are stored directly in
+// the map planes, so an empty stack is simply one with a qty of 0.
+struct ItemStack {
+    ItemStack() : ident(0), qty(0) { }
+    ItemStack(int ident, int qty) : ident(ident), qty(qty) { }
+    bool empty() const { return qty == 0; }
+    bool operator==(const ItemStack &rhs) const { return ident == rhs.ident && qty == rhs.qty; }
+    bool operator!=(const ItemStack &rhs) const { return !(*this == rhs); }
+
+    short ident;
+    unsigned short qty;
+};
 
-    int type;
-    const ItemDef &def;
-    Point pos;
+// A set of map positions stored as a bounding box with one bit per tile.
+class TileMask {
+public:
+    TileMask() : mWidth(0), mHeight(0), mCount(0) { }
+    void reset(const Point &origin, int width, int height) {
+        mOrigin = origin;
+        mWidth = width;
+        mHeight = height;
+        mCount = 0;
+        mBits.assign((width * height + 31) / 32, 0);
+    }
+    bool contains(const Point &p) const {
+        int x = p.x - mOrigin.x, y = p.y - mOrigin.y;
+        if (x < 0 || y < 0 || x >= mWidth || y >= mHeight) return false;
+        int i = x + y * mWidth;
+        return mBits[i >> 5] & (1u << (i & 31));
+    }
+    // p must lie inside the bounding box given to reset()
+    void insert(const Point &p) {
+        int i = (p.x - mOrigin.x) + (p.y - mOrigin.y) * mWidth;
+        unsigned &word = mBits[i >> 5];
+        if (word & (1u << (i & 31))) return;
+        word |= 1u << (i & 31);
+        ++mCount;
+    }
+    void setWord(unsigned index, unsigned bits) {
+        if (index >= mBits.size()) return;
+        int spare = mBits.size() * 32 - mWidth * mHeight;
+        if (index == mBits.size() - 1 && spare) bits &= ~0u >> spare;
+        mCount -= std::bitset<32>(mBits[index]).count();
+        mCount += std::bitset<32>(bits).count();
+        mBits[index] = bits;
+    }
+    unsigned size() const { return mCount; }
+    bool empty() const { return mCount == 0; }
+    const Point& origin() const { return mOrigin; }
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+    const std::vector<unsigned>& words() const { return mBits; }
+
+    // visits every position in the set in reading order
+    template<class F>
+    void forEach(F callback) const {
+        for (unsigned w = 0; w < mBits.size(); ++w) {
+            unsigned bits = mBits[w];
+            for (int b = 0; bits; ++b, bits >>= 1) {
+                if (!(bits & 1)) continue;
+                int i = w * 32 + b;
+                callback(Point(mOrigin.x + i % mWidth, mOrigin.y + i / mWidth));
+            }
+        }
+    }
+
+private:
+    Point mOrigin;
+    int mWidth, mHeight;
+    unsigned mCount;
+    std::vector<unsigned> mBits;
 };
 
 struct Room {
     Room()
-    : type(0), def(nullptr)
+    : type(0), def(nullptr), handle(0), dirty(false), needsRescale(false)
     { }
     int type;
     const RoomDef *def;
-    std::vector<Point> points;
+    TileMask tiles;
+    // number of tiles in the room holding each building ident
+    std::map<int, int> buildings;
+    unsigned handle;
+    bool dirty, needsRescale;
+};
+
+// What an actor decided to do during a tick. Intents are worked out in
+// parallel against the world as it was at the start of the tick, then
+// applied one actor at a time in actor list order.
+const int INTENT_IDLE   = 0;    // did not get a turn
+const int INTENT_AGE    = 1;    // took a turn but only got older
+const int INTENT_MOVE   = 2;
+const int INTENT_ATTACK = 3;
+const int INTENT_EAT    = 4;
+const int INTENT_GROW   = 5;
+struct ActorIntent {
+    int type;
+    Dir dir;
+    Point target;
+    // handle of the actor to attack
+    unsigned victim;
 };
 
+// A single map position. The world stores its map as separate planes, so
+// World::at() assembles one of these by value.
 struct Tile {
-    Tile() : terrain(0), building(0), room(nullptr), actor(nullptr), item(0) { }
-    Tile(int tile) : terrain(tile), room(nullptr), actor(nullptr), item(0) { }
+    Tile() : terrain(0), building(0), room(nullptr), actor(nullptr) { }
+    Tile(int tile) : terrain(tile), building(0), room(nullptr), actor(nullptr) { }
 
     int terrain;
     int building;
     Room *room;
     Actor *actor;
-    Item *item;
+    ItemStack item;
+};
+
+// Maps the 32-bit handles kept in the tile planes back to the objects they
+// refer to. Handle 0 is always empty and freed handles are reused.
+template<class T>
+class HandleTable {
+public:
+    HandleTable() : mSlots(1, nullptr) { }
+    unsigned add(T *object) {
+        if (!object) return 0;
+        if (mFree.empty()) {
+            mSlots.push_back(object);
+            return mSlots.size() - 1;
+        }
+        unsigned handle = mFree.back();
+        mFree.pop_back();
+        mSlots[handle] = object;
+        return handle;
+    }
+    void remove(unsigned handle) {
+        if (handle == 0 || handle >= mSlots.size() || !mSlots[handle]) return;
+        mSlots[handle] = nullptr;
+        mFree.push_back(handle);
+    }
+    T* get(unsigned handle) const {
+        return mSlots[handle];
+    }
+    unsigned size() const { return mSlots.size(); }
+    void clear() {
+        mSlots.assign(1, nullptr);
+        mFree.clear();
+    }
+
+private:
+    std::vector<T*> mSlots;
+    std::vector<unsigned> mFree;
+};
+
+// Owns objects in fixed-size pages, so they sit close together and never
+// move once created. A handle is a slot index plus the slot's generation;
+// destroying an object bumps the generation, so old handles to it resolve to
+// nullptr instead of to whatever reuses the slot. A slot whose generations
+// have all been used is retired rather than wrapping back to a handle that
+// was already given out. Handle 0 is always empty.
+template<class T>
+class Slab {
+public:
+    static const unsigned INDEX_BITS = 24;
+    static const unsigned INDEX_MASK = (1u << INDEX_BITS) - 1;
+    static const unsigned GENERATION_MAX = 0xFFFFFFFFu >> INDEX_BITS;
+
+    Slab() : mNext(1), mCount(0) { }
+    ~Slab() { clear(); }
+    Slab(const Slab&) = delete;
+    Slab& operator=(const Slab&) = delete;
+
+    // Constructs an object and returns its handle, or 0 if every index is used.
+    template<class... Args>
+    unsigned create(Args&&... args) {
+        unsigned index;
+        if (!mFree.empty()) {
+            index = mFree.back();
+            mFree.pop_back();
+        } else {
+            // slots left retired by a clear are skipped
+            do {
+                if (mNext > INDEX_MASK) return 0;
+                index = mNext++;
+                if ((index >> PAGE_SHIFT) >= mPages.size()) {
+                    mPages.push_back(std::unique_ptr<Slot[]>(new Slot[PAGE_SIZE]));
+                }
+            } while (slotAt(index).generation > GENERATION_MAX);
+        }
+        Slot &slot = slotAt(index);
+        new (&slot.storage) T(std::forward<Args>(args)...);
+        slot.live = true;
+        ++mCount;
+        return (slot.generation << INDEX_BITS) | index;
+    }
+    // Returns false if the handle was already stale.
+    bool destroy(unsigned handle) {
+        T *object = get(handle);
+        if (!object) return false;
+        object->~T();
+        Slot &slot = slotAt(handle & INDEX_MASK);
+        slot.live = false;
+        if (++slot.generation <= GENERATION_MAX) mFree.push_back(handle & INDEX_MASK);
+        --mCount;
+        return true;
+    }
+    T* get(unsigned handle) const {
+        unsigned index = handle & INDEX_MASK;
+        if (index == 0 || index >= mNext) return nullptr;
+        const Slot &slot = slotAt(index);
+        if (!slot.live || slot.generation != (handle >> INDEX_BITS)) return nullptr;
+        return reinterpret_cast<T*>(const_cast<typename Slot::Storage*>(&slot.storage));
+    }
+    unsigned size() const { return mCount; }
+    // Destroys every object. Pages are kept for reuse and generations keep
+    // counting, so handles from before the clear stay stale.
+    void clear() {
+        for (unsigned index = 1; index < mNext; ++index) {
+            Slot &slot = slotAt(index);
+            if (!slot.live) continue;
+            reinterpret_cast<T*>(&slot.storage)->~T();
+            slot.live = false;
+            ++slot.generation;
+        }
+        mFree.clear();
+        mNext = 1;
+        mCount = 0;
+    }
+
+private:
+    static const unsigned PAGE_SHIFT = 10;
+    static const unsigned PAGE_SIZE = 1u << PAGE_SHIFT;
+    struct Slot {
+        typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+        Slot() : generation(0), live(false) { }
+        Storage storage;
+        // past GENERATION_MAX once retired, so no handle matches it
+        unsigned generation;
+        bool live;
+    };
+    Slot& slotAt(unsigned index) {
+        return mPages[index >> PAGE_SHIFT][index & (PAGE_SIZE - 1)];
+    }
+    const Slot& slotAt(unsigned index) const {
+        return mPages[index >> PAGE_SHIFT][index & (PAGE_SIZE - 1)];
+    }
+
+    std::vector<std::unique_ptr<Slot[]> > mPages;
+    std::vector<unsigned> mFree;
+    unsigned mNext, mCount;
+};
+
+// One layer of a map chunk. A uniform plane is just its fill value; per-cell
+// storage is only allocated once a cell is given a different value.
+template<class T>
+class ChunkPlane {
+public:
+    ChunkPlane() : mFill(), mCells(nullptr) { }
+    ChunkPlane(ChunkPlane &&rhs) : mFill(rhs.mFill), mCells(rhs.mCells) { rhs.mCells = nullptr; }
+    ChunkPlane(const ChunkPlane&) = delete;
+    ChunkPlane& operator=(const ChunkPlane&) = delete;
+    ~ChunkPlane() { delete[] mCells; }
+
+    T get(int cell) const {
+        return mCells ? mCells[cell] : mFill;
+    }
+    void set(int cell, T value) {
+        if (!mCells) {
+            if (value == mFill) return;
+            mCells = new T[CHUNK_AREA];
+            for (int i = 0; i < CHUNK_AREA; ++i) mCells[i] = mFill;
+        }
+        mCells[cell] = value;
+    }
+    void fill(T value) {
+        delete[] mCells;
+        mCells = nullptr;
+        mFill = value;
+    }
+    // Collapse back to a single fill value if every cell is the same.
+    bool compact() {
+        if (!mCells) return true;
+        for (int i = 1; i < CHUNK_AREA; ++i) {
+            if (mCells[i] != mCells[0]) return false;
+        }
+        fill(mCells[0]);
+        return true;
+    }
+    bool uniform() const { return mCells == nullptr; }
+    // Copies all CHUNK_AREA cells out to a flat array.
+    void copyTo(T *cells) const {
+        if (mCells) std::copy(mCells, mCells + CHUNK_AREA, cells);
+        else std::fill(cells, cells + CHUNK_AREA, mFill);
+    }
+    // Storage for all CHUNK_AREA cells, for loading them in bulk. If the
+    // plane was uniform the caller must set every cell.
+    T* rawCells() {
+        if (!mCells) mCells = new T[CHUNK_AREA];
+        return mCells;
+    }
+
+private:
+    T mFill;
+    T *mCells;
+};
+
+struct MapChunk {
+    ChunkPlane<short> terrain, building;
+    ChunkPlane<unsigned> room, actor;
+    ChunkPlane<ItemStack> item;
+};
+
+// Buckets objects by coarse map cell so that searches around a point only
+// visit the objects that are actually nearby.
+template<class T>
+class SpatialHash {
+public:
+    struct Entry {
+        Point pos;
+        T value;
+    };
+
+    SpatialHash() : mCount(0) { }
+    void insert(const Point &pos, T value) {
+        mBuckets[keyOf(pos.x, pos.y)].push_back(Entry{pos, value});
+        ++mCount;
+    }
+    void remove(const Point &pos, T value) {
+        auto iter = mBuckets.find(keyOf(pos.x, pos.y));
+        if (iter == mBuckets.end()) return;
+        std::vector<Entry> &bucket = iter->second;
+        for (unsigned i = 0; i < bucket.size(); ++i) {
+            if (bucket[i].value == value && bucket[i].pos == pos) {
+                bucket[i] = bucket.back();
+                bucket.pop_back();
+                --mCount;
+                return;
+            }
+        }
+    }
+    void clear() {
+        mBuckets.clear();
+        mCount = 0;
+    }
+    unsigned size() const { return mCount; }
+    // Calls callback(pos, value) for every entry within radius of centre
+    // (measured as a square, like the tile scans this replaces).
+    template<class F>
+    void forEachNear(const Point &centre, int radius, F callback) const {
+        int left = centre.x - radius, right = centre.x + radius;
+        int top = centre.y - radius, bottom = centre.y + radius;
+        if (left < 0) left = 0;
+        if (top < 0) top = 0;
+        if (right < left || bottom < top) return;
+        for (int by = top >> BUCKET_SHIFT; by <= bottom >> BUCKET_SHIFT; ++by) {
+            for (int bx = left >> BUCKET_SHIFT; bx <= right >> BUCKET_SHIFT; ++bx) {
+                auto iter = mBuckets.find(bucketKey(bx, by));
+                if (iter == mBuckets.end()) continue;
+                for (const Entry &entry : iter->second) {
+                    if (entry.pos.x < left || entry.pos.x > right) continue;
+                    if (entry.pos.y < top || entry.pos.y > bottom) continue;
+                    callback(entry.pos, entry.value);
+                }
+            }
+        }
+    }
+
+private:
+    static const int BUCKET_SHIFT = 4;
+    static unsigned bucketKey(int bx, int by) {
+        return (static_cast<unsigned>(by) << 16) | static_cast<unsigned>(bx);
+    }
+    static unsigned keyOf(int x, int y) {
+        return bucketKey(x >> BUCKET_SHIFT, y >> BUCKET_SHIFT);
+    }
+
+    std::unordered_map<unsigned, std::vector<Entry> > mBuckets;
+    unsigned mCount;
 };
 
 struct LogMessage {
     std::string msg;
 };
 
+struct RestResult {
+    int reason;
+    int turns;
+};
+
 struct ConfigData {
     int screenWidth, screenHeight;
+    // see World::setSimulationLod
+    int simRadius, simFarInterval;
+    // longest rest and the REST_ON_* conditions that interrupt it
+    int restMaxTurns, restRadius;
+    unsigned restStopOn;
+    bool compressSaves;
+    // turns between autosaves, or 0 for none
+    int autosaveTurns;
 };
 
+// A command the player gave, with what it takes to give it again: the turn,
+// random state and inventory selection it was given with, and the answers
+// to any direction prompts it asked.
+struct JournalEntry {
+    unsigned turn;
+    std::uint64_t random[2];
+    int command, selection;
+    Dir dir;
+    std::vector<Dir> answers;
+};
+
+class SaveReader;
+class SaveWriter;
+struct PendingSave;
+class JournalWriter;
+
 class World {
 public:
 
@@ -254,6 +731,8 @@ public:
     ~World();
     void allocMap(int width, int height);
     void deallocMap();
+    void compactMap();
+    unsigned long mapMemory() const;
     int width()  const { return mWidth; }
     int height() const { return mHeight; }
     bool valid(const Point &p) const;
@@ -261,24 +740,61 @@ public:
 
     const Point& getCamera() const;
     void setCamera(const Point &to);
+    void centreCamera(const Point &on);
 
-    Point findDropSpace(const Point &near) const;
-    const Tile& at(const Point &p) const;
+    // nearest tile to near (itself or a neighbour) that can take more of ident
+    Point findDropSpace(const Point &near, int ident) const;
+    Tile at(const Point &p) const;
+    int  getTerrain(const Point &p) const;
+    int  getBuilding(const Point &p) const;
     int  getTileVariant(const Point &p) const;
     void setTerrain(const Point &pos, int toTile);
     void setBuilding(const Point &pos, int toTile);
+    // Rooms touched by tile edits made between beginBatch() and endBatch()
+    // are only rescaled once, when the outermost batch ends.
+    void beginBatch();
+    void endBatch();
+    // Bulk edits for map generation. These write the tile planes directly
+    // and skip all room bookkeeping; call finishBulkEdit() once afterwards.
+    // If onlyOver is not -1, only tiles currently holding onlyOver change.
+    void setRaw(int layer, const Point &pos, int tile);
+    void fillSpan(int layer, int y, int x0, int x1, int tile, int onlyOver = -1);
+    void fillRect(int layer, const Point &corner, int width, int height, int tile, int onlyOver = -1);
+    void fillDisc(int layer, const Point &centre, int radius, int tile, int onlyOver = -1);
+    // as fillDisc, but leaves tiles outside the given rectangle alone
+    void fillDiscClipped(int layer, const Point &centre, int radius, int tile, int onlyOver,
+                         const Point &corner, int width, int height);
+    void finishBulkEdit();
     void setActor(const Point &pos, Actor *toActor);
-    void setItem(const Point &pos, Item *toItem);
-
+    // Ground items are one stack per tile. addItems puts as much of qty on
+    // pos as fits and returns how many were placed; takeItems removes up to
+    // qty and returns how many were removed. dropItems spreads qty over pos
+    // and its neighbours, merging into matching stacks.
+    void setItems(const Point &pos, const ItemStack &stack);
+    int addItems(const Point &pos, int ident, int qty);
+    int takeItems(const Point &pos, int qty);
+    int dropItems(const Point &near, int ident, int qty);
+
+    // Actors live in a slab owned by the world. createActor returns nullptr
+    // if the slab is full; the new actor is not on the map until moveActor.
+    Actor* createActor(const ActorDef &def);
+    void destroyActor(Actor *actor);
+    // nullptr if the actor this handle referred to has been destroyed
+    Actor* getActor(unsigned handle) const;
+    // Plants are not visited every tick, so read ages through this.
+    int getActorAge(const Actor *actor) const;
     bool moveActor(Actor *actor, const Point &to);
     bool tryMoveActor(Actor *actor, Dir baseDir, bool allowSidestep = true);
     const Actor* getPlayer() const;
     Actor* getPlayer();
-    bool moveItem(Item *item, const Point &to);
+    // Takes an actor off the map and marks it dead. It stays allocated until
+    // the end of the tick, when dead actors are purged (the player respawns).
     void removeActor(Actor *actor);
-    void removeItem(Item *item);
+    unsigned actorCount() const { return mActors.size(); }
+    // number of ground item stacks
+    unsigned itemCount() const;
 
-    std::vector<Point> findRoomExtents(const Point &pos) const;
+    TileMask findRoomExtents(const Point &pos) const;
     void addRoom(Room *room);
     bool createRoom(const Point &initial);
     void removeRoom(Room *room);
@@ -310,13 +826,70 @@ public:
     void addRoomDef(const RoomDef &td);
     const RoomDef& getRoomDef(int ident) const;
     int roomDefCount() const { return mRoomDefs.size(); }
+    void indexDefs();
+    unsigned getTileFlags(int ident) const {
+        int slot = mTileIndex.slot(ident);
+        // before indexDefs, or if it couldn't index the tiles
+        if (slot < 0) return tileFlags(getTileDef(ident));
+        return mTileFlags[slot];
+    }
+    static unsigned tileFlags(const TileDef &td);
 
     void tick();
+    // Runs up to maxTurns ticks back to back, stopping early on any of the
+    // stopOn conditions within radius of the player. progress is called with
+    // the turns done so far every so often and can return false to cancel.
+    RestResult rest(int maxTurns, unsigned stopOn, int radius,
+                    const std::function<bool(int)> &progress);
+    bool hostileNear(const Point &pos, int radius) const;
+    // threads used to plan actor turns; 0 means one per core
+    void setTickThreads(unsigned threads);
+    // Actors more than radius tiles from the player only act every
+    // farInterval turns and catch up on what they missed when they do.
+    // A radius of 0 runs every actor every turn.
+    void setSimulationLod(int radius, int farInterval);
     unsigned getTurn() const { return turn; }
     void getTime(int *day, int *hour, int *minute) const;
 
-    bool savegame(const std::string &filename) const;
+    // Saving to the file last saved to or loaded from appends only what
+    // changed since then. The file is rewritten in full when it is a
+    // different file, when compact is set, or once enough changes pile up.
+    bool savegame(const std::string &filename, bool compact = false);
+    // Builds the same save as savegame, then compresses and writes it on a
+    // background thread. Does nothing if the last one is still being written.
+    bool autosave(const std::string &filename);
+    // Reports on the background save once it is done; with wait set, waits
+    // for it first.
+    void finishAutosave(bool wait);
+    // how long the last autosave held up the game, in milliseconds
+    double autosaveSnapshotTime() const { return mAutosaveSnapshotTime; }
+
+    // Every command given since the last save goes in a journal next to it,
+    // so a game that stops without saving can be brought back by giving
+    // them again. Entries are written a turn at a time on another thread.
+    // Call before the command runs, then journal the entry once it has.
+    JournalEntry startJournalEntry(const Command &command);
+    void journalCommand(JournalEntry entry);
+    void flushJournal();
+    // The entries journaled after the save last loaded, if the journal
+    // belongs to that save.
+    bool readJournal(std::vector<JournalEntry> &entries) const;
+    // Call when a command reads input the journal cannot hold, such as a
+    // menu choice; the game loop then saves instead of journaling it.
+    void markJournalGap() { mJournalGap = true; }
+    bool takeJournalGap();
+    // Direction prompts answered during a command are journaled with it,
+    // and answered from the journal while it is replayed.
+    void journalAnswer(Dir dir);
+    bool replayAnswer(Dir &dir);
+    void beginReplay(const JournalEntry &entry);
+    void endReplay();
     bool loadgame(const std::string &filename);
+    // Call after changing an actor other than through World, such as its
+    // inventory, so the next save picks it up.
+    void touchActor(Actor *actor);
+    // compressed saves are much smaller but take longer to write
+    void setSaveCompression(bool compress) { mCompressSaves = compress; }
 
     unsigned tickTime, renderTime;
     bool inProgress, wantsToQuit;
@@ -337,14 +910,124 @@ private:
     std::vector<TileDef> mTileDefs;
     std::vector<RecipeDef> mRecipeDefs;
     std::vector<RoomDef> mRoomDefs;
+    DefIndex mActorIndex, mItemIndex, mTileIndex, mRoomIndex;
+    std::vector<unsigned char> mTileFlags;
 
     Point mCamera;
     std::vector<LogMessage> mLog;
 
+    bool isRoomFloor(const Point &pos) const;
+    void countBuildings(Room *room);
+    void markRoomDirty(Room *room, bool rescale);
+    void markRoomsDirty(const Point &pos);
+    void updateDirtyRooms();
+    void listActor(Actor *actor);
+    void growActor(Actor *actor);
+    void purgeDeadActors();
+    void respawnPlayer();
+    ActorIntent planTurn(const Actor *actor, Random &rng) const;
+    void applyTurn(Actor *actor, const ActorIntent &intent);
+    void catchUpActor(Actor *actor);
+    void markChanged(const Point &p, unsigned char what) {
+        if (!mTrackChanges) return;
+        unsigned index = chunkIndex(p);
+        if ((mChunkChanges[index] & what) == what) return;
+        if (!mChunkChanges[index]) mChangedChunks.push_back(index);
+        mChunkChanges[index] |= what;
+    }
+    void clearChanges(bool allActors);
+    void snapshotSave(PendingSave &save, const std::string &filename, bool compact);
+    void snapshotFull(PendingSave &save);
+    void snapshotChanges(PendingSave &save);
+    bool finishSave(const PendingSave &save);
+    void restartJournal();
+    void openJournal(const std::string &saveFile, unsigned saveSize);
+    void writeChunkItems(SaveWriter &out, unsigned index, unsigned &count) const;
+    void writeActor(SaveWriter &out, const Actor *actor) const;
+    void writeRooms(SaveWriter &out) const;
+    void writeLog(SaveWriter &out) const;
+    bool readItems(SaveReader &in);
+    bool readActors(SaveReader &in);
+    bool readRooms(SaveReader &in);
+    void readLog(SaveReader &in);
+    bool applyChanges(SaveReader &record);
+    bool applyActorChanges(SaveReader &in);
+    void clearChunkItems(unsigned index);
+    ChunkPlane<short>& layerAt(const Point &p, int layer) {
+        MapChunk &chunk = chunkAt(p);
+        return layer == LAYER_BUILDING ? chunk.building : chunk.terrain;
+    }
+
+    MapChunk& chunkAt(const Point &p) {
+        return mChunks[(p.x >> CHUNK_SHIFT) + (p.y >> CHUNK_SHIFT) * mChunksWide];
+    }
+    const MapChunk& chunkAt(const Point &p) const {
+        return mChunks[(p.x >> CHUNK_SHIFT) + (p.y >> CHUNK_SHIFT) * mChunksWide];
+    }
+    static int cellOf(const Point &p) {
+        return (p.x & CHUNK_MASK) + ((p.y & CHUNK_MASK) << CHUNK_SHIFT);
+    }
+    unsigned chunkIndex(const Point &p) const {
+        return (p.x >> CHUNK_SHIFT) + (p.y >> CHUNK_SHIFT) * mChunksWide;
+    }
+    Point chunkCorner(unsigned index) const {
+        return Point((index % mChunksWide) << CHUNK_SHIFT, (index / mChunksWide) << CHUNK_SHIFT);
+    }
+
     int mWidth, mHeight;
-    Tile *mTiles;
+    int mChunksWide, mChunksHigh;
+    std::vector<MapChunk> mChunks;
+    // CHANGED_* bits for each chunk since the last save, the chunks that
+    // have any, and the save they will be appended to
+    static const unsigned char CHANGED_TILES = 1;
+    static const unsigned char CHANGED_ITEMS = 2;
+    std::vector<unsigned char> mChunkChanges;
+    std::vector<unsigned> mChangedChunks;
+    // off until the first full save or load; nothing can be appended before
+    // then, and map generation edits chunks from several threads at once
+    bool mTrackChanges;
+    // handles of actors touched since the last save, and where the saved
+    // actors that have since been destroyed were
+    std::vector<unsigned> mChangedActors;
+    std::vector<Point> mRemovedActors;
+    std::string mSaveFile;
+    unsigned mSaveDeltas, mSaveBaseSize, mSaveDeltaSize;
+    // the autosave being written on mAutosaveThread, if any
+    std::unique_ptr<PendingSave> mAutosave;
+    std::thread mAutosaveThread;
+    std::atomic<bool> mAutosaveDone;
+    double mAutosaveSnapshotTime;
+    // the journal file and entries made since the last save was started;
+    // mJournalBatch holds the ones not yet handed to mJournal
+    std::unique_ptr<JournalWriter> mJournal;
+    std::string mJournalFile;
+    std::unique_ptr<SaveWriter> mJournalTail, mJournalBatch;
+    std::vector<Dir> mJournalAnswers;
+    bool mJournalGap, mReplaying;
+    HandleTable<Room> mRoomHandles;
+    Slab<Actor> mActorSlab;
+    SpatialHash<Actor*> mActorHash;
+    std::unordered_map<int, SpatialHash<int> > mItemHash;
+    // every actor; mActive holds the ones that act each tick, while plants
+    // wait in mGrowth until they are due to grow
     std::vector<Actor*> mActors;
+    std::vector<Actor*> mActive;
+    std::vector<Actor*> mDeadActors;
+    TimingWheel mGrowth;
+    std::vector<unsigned> mDueActors;
+    // where plants finished growing this tick, and how often the player died
+    std::vector<Point> mMatured;
+    unsigned mPlayerDeaths;
+    std::vector<Actor*> mTurnActors;
+    std::vector<ActorIntent> mIntents;
+    unsigned mTickThreads;
+    std::unique_ptr<WorkerPool> mPool;
+    int mSimRadius, mSimFarInterval;
+    bool mCompressSaves;
     std::vector<Room*> mRooms;
+    std::vector<Room*> mDirtyRooms;
+    mutable std::vector<unsigned> mRoomVisited;
+    int mBatchDepth;
     Actor *mPlayer;
 
     unsigned turn;
@@ -380,11 +1063,14 @@ bool actionTake(World &w, Actor *player, const Command &command, bool silent);
 bool actionTalkActor(World &w, Actor *player, const Command &command, bool silent);
 bool actionUse(World &w, Actor *player, const Command &command, bool silent);
 bool actionWait(World &w, Actor *player, const Command &command, bool silent);
+bool actionRest(World &w, Actor *player, const Command &command, bool silent);
 bool actionViewLog(World &w, Actor *player, const Command &command, bool silent);
 
 
 // actions.cpp
 void makeLootAt(World &w, const LootTable *table, const Point &where, bool showMessages);
+// "a rock" or "3 rocks"
+std::string itemStackName(const ItemDef &def, int qty);
 
 // debug.cpp
 void doDebug(World &w, Actor *player);
@@ -395,6 +1081,13 @@ const Command& findCommand(int key, const Command *commandList);
 std::string commandName(int command);
 ActionHandler commandAction(int command);
 
+// journal.cpp
+// Gives again the commands journaled since the save filename was loaded
+// from, taking their handlers from actionFor. Stops at the first that no
+// longer lines up with the world and saves to filename, dropping the rest
+// of the journal; returns false if it had to.
+bool replayJournal(World &w, const std::string &filename, ActionHandler (*actionFor)(int));
+
 // ui.cpp
 void ui_MessageBox(const std::string &title, const std::string &message);
 void ui_MessageBox_Instant(const std::string &message);
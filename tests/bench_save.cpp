@@ -0,0 +1,189 @@
+// Benchmarks World::savegame and World::loadgame on generated maps.
+// Results are written to stdout as JSON; log output goes to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <physfs.h>
+#include "test.h"
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+const char *SAVE_FILE = "bench.sav";
+const int RUNS = 5;
+
+struct BenchResult {
+    std::string name;
+    int size;
+    long long bytes;
+    std::vector<double> saveTimes, loadTimes;
+    // autosave only: how long the game was held up
+    std::vector<double> snapshotTimes;
+};
+
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+long long saveSize() {
+    PHYSFS_Stat stat;
+    return PHYSFS_stat((std::string("/save/") + SAVE_FILE).c_str(), &stat) ? stat.filesize : -1;
+}
+
+bool runBench(World &w, int size, bool compress, BenchResult &result) {
+    result.name = std::string(compress ? "save-" : "save-raw-") + std::to_string(size);
+    result.size = size;
+    w.setSaveCompression(compress);
+    for (int i = 0; i < RUNS; ++i) {
+        w.allocMap(size, size);
+        buildmap(w, size);
+        // age the map a little so it has loot, grown plants and a log
+        for (int t = 0; t < 20; ++t) w.tick();
+
+        auto start = std::chrono::steady_clock::now();
+        if (!w.savegame(SAVE_FILE)) return false;
+        result.saveTimes.push_back(msSince(start));
+        w.deallocMap();
+
+        start = std::chrono::steady_clock::now();
+        if (!w.loadgame(SAVE_FILE)) return false;
+        result.loadTimes.push_back(msSince(start));
+        w.deallocMap();
+    }
+    result.bytes = saveSize();
+    PHYSFS_delete(SAVE_FILE);
+    return true;
+}
+
+// Times saving ten turns of changes on top of a full save, and loading the
+// two together. bytes is the size of the appended record alone.
+bool runDeltaBench(World &w, int size, BenchResult &result) {
+    result.name = "save-delta-" + std::to_string(size);
+    result.size = size;
+    w.setSaveCompression(true);
+    for (int i = 0; i < RUNS; ++i) {
+        w.allocMap(size, size);
+        buildmap(w, size);
+        for (int t = 0; t < 20; ++t) w.tick();
+        if (!w.savegame(SAVE_FILE)) return false;
+        const long long baseSize = saveSize();
+        for (int t = 0; t < 10; ++t) w.tick();
+
+        auto start = std::chrono::steady_clock::now();
+        if (!w.savegame(SAVE_FILE)) return false;
+        result.saveTimes.push_back(msSince(start));
+        result.bytes = saveSize() - baseSize;
+        w.deallocMap();
+
+        start = std::chrono::steady_clock::now();
+        if (!w.loadgame(SAVE_FILE)) return false;
+        result.loadTimes.push_back(msSince(start));
+        w.deallocMap();
+    }
+    PHYSFS_delete(SAVE_FILE);
+    return true;
+}
+
+// Times a full autosave: the snapshot taken on the calling thread, and the
+// whole save until the background write is done.
+bool runAutosaveBench(World &w, int size, BenchResult &result) {
+    result.name = "autosave-" + std::to_string(size);
+    result.size = size;
+    w.setSaveCompression(true);
+    for (int i = 0; i < RUNS; ++i) {
+        w.allocMap(size, size);
+        buildmap(w, size);
+        for (int t = 0; t < 20; ++t) w.tick();
+
+        auto start = std::chrono::steady_clock::now();
+        if (!w.autosave(SAVE_FILE)) return false;
+        w.finishAutosave(true);
+        result.saveTimes.push_back(msSince(start));
+        result.snapshotTimes.push_back(w.autosaveSnapshotTime());
+        w.deallocMap();
+
+        start = std::chrono::steady_clock::now();
+        if (!w.loadgame(SAVE_FILE)) return false;
+        result.loadTimes.push_back(msSince(start));
+        w.deallocMap();
+    }
+    result.bytes = saveSize();
+    PHYSFS_delete(SAVE_FILE);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    const std::string writeDir = makeTempDir();
+    if (writeDir.empty() || !PHYSFS_setWriteDir(writeDir.c_str())) {
+        std::cerr << "Failed to set write directory.\n";
+        return 1;
+    }
+    PHYSFS_mount(".", "/", true);
+    PHYSFS_mount(writeDir.c_str(), "/save", false);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cerr << "Failed to load game data.\n";
+        return 1;
+    }
+    w.selection = 0;
+
+    const int sizes[] = { 256, 1024, 2048 };
+    std::vector<BenchResult> results;
+    for (bool compress : { false, true }) {
+        for (int size : sizes) {
+            BenchResult result;
+            if (!runBench(w, size, compress, result)) {
+                std::cerr << "Save or load failed at size " << size << ".\n";
+                return 1;
+            }
+            results.push_back(result);
+        }
+    }
+    for (int size : sizes) {
+        BenchResult result;
+        if (!runDeltaBench(w, size, result)) {
+            std::cerr << "Change save or load failed at size " << size << ".\n";
+            return 1;
+        }
+        results.push_back(result);
+    }
+    for (int size : sizes) {
+        BenchResult result;
+        if (!runAutosaveBench(w, size, result)) {
+            std::cerr << "Autosave or load failed at size " << size << ".\n";
+            return 1;
+        }
+        results.push_back(result);
+    }
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (unsigned i = 0; i < results.size(); ++i) {
+        const BenchResult &result = results[i];
+        std::cout << "    {\"name\": \"" << result.name << "\", \"size\": " << result.size;
+        std::cout << ", \"runs\": " << RUNS << ", \"bytes\": " << result.bytes;
+        std::cout << ", \"save_ms\": " << median(result.saveTimes);
+        if (!result.snapshotTimes.empty()) std::cout << ", \"snapshot_ms\": " << median(result.snapshotTimes);
+        std::cout << ", \"load_ms\": " << median(result.loadTimes) << "}";
+        std::cout << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    std::cout << "  ]\n}\n";
+
+    PHYSFS_deinit();
+    removeTempDir(writeDir);
+    return 0;
+}
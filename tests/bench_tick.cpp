@@ -0,0 +1,223 @@
+// Benchmarks World::tick on generated maps and a few targeted scenarios.
+// Results are written to stdout as JSON; log output goes to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <physfs.h>
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+const int WARMUP_TICKS = 20;
+// simulation LOD settings for the lod-map runs; the defaults in configRead
+const int LOD_RADIUS = 64;
+const int LOD_FAR_INTERVAL = 8;
+
+const int ACTOR_KOBOLD = 2;
+const int ACTOR_GROWN_WHEAT = 1005;
+const int ACTOR_GROWN_CARROT = 1007;
+const int ACTOR_GROWN_TURNIP = 1009;
+const int ACTOR_ZOMBIE = 2000;
+const int TILE_WOOD_WALL = 104;
+const int TILE_BASIC_WORKBENCH = 500;
+const int TILE_BED = 503;
+
+struct BenchResult {
+    std::string name;
+    int size;
+    unsigned long seed;
+    std::vector<double> tickTimes;
+    unsigned actors, items;
+};
+
+
+void makeWorld(World &w, int size, unsigned long seed) {
+    w.allocMap(size, size);
+    buildmap(w, seed);
+    w.getRandom().seed(seed);
+    // keep the player alive so a respawn never changes what a run simulates
+    w.getPlayer()->health = 1000000000;
+}
+
+bool isOpen(World &w, const Point &p) {
+    return w.valid(p) && !w.at(p).actor && w.getBuilding(p) == 0
+        && !(w.getTileFlags(w.getTerrain(p)) & TF_SOLID);
+}
+
+void spawnActor(World &w, int ident, const Point &p) {
+    Actor *actor = w.createActor(w.getActorDef(ident));
+    if (!actor) return;
+    actor->reset();
+    if (!w.moveActor(actor, p)) w.destroyActor(actor);
+}
+
+// Removes every actor except the player from the given area.
+void clearActors(World &w, const Point &corner, int width, int height) {
+    for (int y = corner.y; y < corner.y + height; ++y) {
+        for (int x = corner.x; x < corner.x + width; ++x) {
+            Actor *actor = w.at(Point(x, y)).actor;
+            if (!actor || actor == w.getPlayer()) continue;
+            w.removeActor(actor);
+        }
+    }
+}
+
+void setupSwarm(World &w) {
+    makeWorld(w, 256, 7);
+    Random rng;
+    rng.seed(7);
+    const Point centre(w.width() / 2, w.height() / 2);
+    int placed = 0;
+    for (int tries = 0; placed < 500 && tries < 100000; ++tries) {
+        Point p(centre.x + static_cast<int>(rng.next32() % 81) - 40,
+                centre.y + static_cast<int>(rng.next32() % 81) - 40);
+        if (!isOpen(w, p)) continue;
+        spawnActor(w, ACTOR_ZOMBIE, p);
+        ++placed;
+    }
+}
+
+void setupCrops(World &w) {
+    makeWorld(w, 256, 11);
+    const int crops[] = { ACTOR_GROWN_WHEAT, ACTOR_GROWN_CARROT, ACTOR_GROWN_TURNIP };
+    const Point corner(78, 78);
+    const int fieldSize = 100;
+    clearActors(w, corner, fieldSize, fieldSize);
+    w.fillRect(LAYER_TERRAIN, corner, fieldSize, fieldSize, TILE_DIRT);
+    w.fillRect(LAYER_BUILDING, corner, fieldSize, fieldSize, 0);
+    w.finishBulkEdit();
+    for (int y = 0; y < fieldSize; ++y) {
+        for (int x = 0; x < fieldSize; ++x) {
+            Point p(corner.x + x, corner.y + y);
+            if (isOpen(w, p)) spawnActor(w, crops[(x + y) % 3], p);
+        }
+    }
+}
+
+void setupColony(World &w) {
+    makeWorld(w, 256, 13);
+    const Point corner(68, 68);
+    const int roomsAcross = 12;
+    const int pitch = 10;
+    const int colonySize = roomsAcross * pitch + 1;
+    clearActors(w, corner, colonySize, colonySize);
+    w.fillRect(LAYER_TERRAIN, corner, colonySize, colonySize, TILE_DIRT);
+    w.fillRect(LAYER_BUILDING, corner, colonySize, colonySize, 0);
+    for (int i = 0; i <= roomsAcross; ++i) {
+        w.fillRect(LAYER_BUILDING, Point(corner.x, corner.y + i * pitch), colonySize, 1, TILE_WOOD_WALL);
+        w.fillRect(LAYER_BUILDING, Point(corner.x + i * pitch, corner.y), 1, colonySize, TILE_WOOD_WALL);
+    }
+    w.finishBulkEdit();
+
+    for (int ry = 0; ry < roomsAcross; ++ry) {
+        for (int rx = 0; rx < roomsAcross; ++rx) {
+            Point inner(corner.x + rx * pitch + 1, corner.y + ry * pitch + 1);
+            w.setBuilding(inner, (rx + ry) % 2 ? TILE_BED : TILE_BASIC_WORKBENCH);
+            w.createRoom(Point(inner.x + 4, inner.y + 4));
+            spawnActor(w, ACTOR_KOBOLD, Point(inner.x + 3, inner.y + 3));
+            spawnActor(w, ACTOR_KOBOLD, Point(inner.x + 5, inner.y + 5));
+        }
+    }
+}
+
+BenchResult runBench(World &w, const std::string &name, unsigned long seed, int ticks) {
+    for (int i = 0; i < WARMUP_TICKS; ++i) {
+        w.tick();
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.size = w.width();
+    result.seed = seed;
+    for (int i = 0; i < ticks; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        w.tick();
+        auto end = std::chrono::steady_clock::now();
+        result.tickTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    result.actors = w.actorCount();
+    result.items = w.itemCount();
+    w.deallocMap();
+    return result;
+}
+
+double percentile(std::vector<double> sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    std::sort(sorted.begin(), sorted.end());
+    unsigned rank = static_cast<unsigned>(fraction * sorted.size() + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > sorted.size()) rank = sorted.size();
+    return sorted[rank - 1];
+}
+
+void writeResult(const BenchResult &result, bool last) {
+    double total = 0;
+    for (double t : result.tickTimes) total += t;
+    double mean = result.tickTimes.empty() ? 0 : total / result.tickTimes.size();
+
+    std::cout << "    {\"name\": \"" << result.name << "\", \"size\": " << result.size;
+    std::cout << ", \"seed\": " << result.seed;
+    std::cout << ", \"warmup\": " << WARMUP_TICKS << ", \"ticks\": " << result.tickTimes.size();
+    std::cout << ", \"mean_ms\": " << mean;
+    std::cout << ", \"p50_ms\": " << percentile(result.tickTimes, 0.5);
+    std::cout << ", \"p99_ms\": " << percentile(result.tickTimes, 0.99);
+    std::cout << ", \"actors\": " << result.actors << ", \"items\": " << result.items << "}";
+    std::cout << (last ? "\n" : ",\n");
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    PHYSFS_mount(".", "/", true);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cerr << "Failed to load game data.\n";
+        return 1;
+    }
+    w.selection = 0;
+
+    struct MapBench {
+        int size;
+        unsigned long seed;
+        int ticks;
+    };
+    const MapBench maps[] = {
+        { 128,  128,  300 },
+        { 256,  256,  300 },
+        { 512,  512,  200 },
+        { 1024, 1024, 100 },
+    };
+
+    std::vector<BenchResult> results;
+    for (const MapBench &map : maps) {
+        makeWorld(w, map.size, map.seed);
+        results.push_back(runBench(w, "map-" + std::to_string(map.size), map.seed, map.ticks));
+    }
+    // the same maps with distant actors only updated every few turns
+    w.setSimulationLod(LOD_RADIUS, LOD_FAR_INTERVAL);
+    for (const MapBench &map : maps) {
+        makeWorld(w, map.size, map.seed);
+        results.push_back(runBench(w, "lod-map-" + std::to_string(map.size), map.seed, map.ticks));
+    }
+    w.setSimulationLod(0, 1);
+    setupSwarm(w);
+    results.push_back(runBench(w, "monster-swarm", 7, 200));
+    setupCrops(w);
+    results.push_back(runBench(w, "crop-field", 11, 200));
+    setupColony(w);
+    results.push_back(runBench(w, "colony", 13, 200));
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "{\n  \"benchmarks\": [\n";
+    for (unsigned i = 0; i < results.size(); ++i) {
+        writeResult(results[i], i + 1 == results.size());
+    }
+    std::cout << "  ]\n}\n";
+
+    PHYSFS_deinit();
+    return 0;
+}
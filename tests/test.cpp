@@ -1,5 +1,9 @@
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
 #include "test.h"
 
 
@@ -23,3 +27,25 @@ bool requireUnsignedLongLong(const std::string &testname, unsigned long long lef
     std::cout << left << ".\n";
     return false;
 }
+
+std::string makeTempDir() {
+    const char *base = std::getenv("TMPDIR");
+    std::string pattern = std::string(base && *base ? base : "/tmp") + "/craftrl-test-XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    if (!mkdtemp(path.data())) return "";
+    return path.data();
+}
+
+void removeTempDir(const std::string &path) {
+    if (path.empty()) return;
+    DIR *dir = opendir(path.c_str());
+    if (dir) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") unlink((path + "/" + name).c_str());
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
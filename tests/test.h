@@ -7,4 +7,10 @@ bool requireInt(const std::string &testname, int left, int right);
 bool requireString(const std::string &testname, const std::string &left, const std::string &right);
 bool requireUnsignedLongLong(const std::string &testname, unsigned long long left, unsigned long long right);
 
+// An empty directory for a test to write its files to, so a test run never
+// touches the player's own saves. Returns an empty string on failure.
+std::string makeTempDir();
+// Removes the directory and the files in it.
+void removeTempDir(const std::string &path);
+
 #endif
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <physfs.h>
+#include "test.h"
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+const char *SAVE_FILE = "test_buildmap.sav";
+const char *JOURNAL_FILE = "test_buildmap.jnl";
+
+
+unsigned long long hashTiles(World &w) {
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&hash](long long value) {
+        hash ^= static_cast<unsigned long long>(value);
+        hash *= 1099511628211ull;
+    };
+    for (int y = 0; y < w.height(); ++y) {
+        for (int x = 0; x < w.width(); ++x) {
+            Point p(x, y);
+            mix(w.getTerrain(p));
+            mix(w.getBuilding(p));
+            const Actor *actor = w.at(p).actor;
+            mix(actor ? actor->def.ident : -1);
+        }
+    }
+    return hash;
+}
+
+unsigned long long hashMap(World &w, int size, unsigned long seed, unsigned threads) {
+    w.allocMap(size, size);
+    buildmap(w, seed, threads);
+    unsigned long long hash = hashTiles(w);
+    w.deallocMap();
+    return hash;
+}
+
+bool testThreadCounts(World &w, int size) {
+    std::cout << "Testing map generation at size " << size << ".\n";
+    const unsigned long seed = 12345;
+    unsigned many = std::thread::hardware_concurrency();
+    if (many < 4) many = 4;
+
+    unsigned long long single = hashMap(w, size, seed, 1);
+    if (!requireUnsignedLongLong("same map on 1 thread twice", hashMap(w, size, seed, 1), single)) return false;
+    if (!requireUnsignedLongLong("same map on 2 threads", hashMap(w, size, seed, 2), single)) return false;
+    if (!requireUnsignedLongLong("same map on " + std::to_string(many) + " threads", hashMap(w, size, seed, many), single)) return false;
+    if (!requireInt("different seed changes map", hashMap(w, size, seed + 1, many) != single, true)) return false;
+    return true;
+}
+
+// A world that has been saved tracks its changes; generating a new map over
+// it must not, both because the workers would race on the change lists and
+// because the next save has to be a full one.
+bool testAfterSave(World &w, int size) {
+    std::cout << "Testing map generation after a save.\n";
+    const unsigned long seed = 12345;
+    unsigned many = std::thread::hardware_concurrency();
+    if (many < 4) many = 4;
+
+    unsigned long long fresh = hashMap(w, size, seed + 1, 1);
+    w.allocMap(size, size);
+    buildmap(w, seed, many);
+    if (!requireInt("first save", w.savegame(SAVE_FILE), true)) return false;
+    w.allocMap(size, size);
+    buildmap(w, seed + 1, many);
+    if (!requireUnsignedLongLong("same map after a save", hashTiles(w), fresh)) return false;
+    if (!requireInt("second save", w.savegame(SAVE_FILE), true)) return false;
+    if (!requireInt("load", w.loadgame(SAVE_FILE), true)) return false;
+    if (!requireUnsignedLongLong("loaded map", hashTiles(w), fresh)) return false;
+    w.deallocMap();
+    PHYSFS_delete(SAVE_FILE);
+    PHYSFS_delete(JOURNAL_FILE);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    const std::string writeDir = makeTempDir();
+    if (writeDir.empty() || !PHYSFS_setWriteDir(writeDir.c_str())) {
+        std::cout << "Failed to set write directory.\n";
+        return 1;
+    }
+    PHYSFS_mount(".", "/", true);
+    PHYSFS_mount(writeDir.c_str(), "/save", false);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cout << "Failed to load game data.\n";
+        return 1;
+    }
+
+    if (!testThreadCounts(w, 256))  return 1;
+    if (!testThreadCounts(w, 300))  return 1;
+    if (!testAfterSave(w, 256))     return 1;
+    std::cout << "All tests passed.\n";
+
+    PHYSFS_deinit();
+    removeTempDir(writeDir);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <physfs.h>
+#include "test.h"
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+
+const int ITEM_STICK = 0;
+const int ITEM_ROCK = 1;
+
+
+bool testStacks(World &w) {
+    std::cout << "Testing ground item stacks.\n";
+    w.allocMap(32, 32);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 32, 32, TILE_DIRT);
+    w.finishBulkEdit();
+    const Point centre(10, 10);
+
+    if (!requireInt("drop onto empty tile", w.dropItems(centre, ITEM_ROCK, 3), 3)) return false;
+    if (!requireInt("drop merges into one stack", w.at(centre).item.qty, 3)) return false;
+    if (!requireInt("one stack on map", w.itemCount(), 1)) return false;
+    w.dropItems(centre, ITEM_ROCK, 2);
+    if (!requireInt("matching drop adds to stack", w.at(centre).item.qty, 5)) return false;
+
+    if (!requireInt("other item spills to neighbour", w.dropItems(centre, ITEM_STICK, 1), 1)) return false;
+    if (!requireInt("stack keeps its item", w.at(centre).item.ident, ITEM_ROCK)) return false;
+    if (!requireInt("two stacks on map", w.itemCount(), 2)) return false;
+    if (!requireInt("nearest stick found", w.findItemNearest(centre, ITEM_STICK, 2) == nowhere, false)) return false;
+
+    if (!requireInt("take part of stack", w.takeItems(centre, 2), 2)) return false;
+    if (!requireInt("stack shrinks", w.at(centre).item.qty, 3)) return false;
+    if (!requireInt("take more than stack holds", w.takeItems(centre, 10), 3)) return false;
+    if (!requireInt("emptied tile", w.at(centre).item.empty(), true)) return false;
+    if (!requireInt("emptied stack leaves search", w.findItemNearest(centre, ITEM_ROCK, 2) == nowhere, true)) return false;
+
+    const Point corner(20, 20);
+    w.dropItems(corner, ITEM_ROCK, ITEM_STACK_MAX + 10);
+    if (!requireInt("full stack", w.at(corner).item.qty, ITEM_STACK_MAX)) return false;
+    if (!requireInt("overflow spills", w.itemCount(), 3)) return false;
+    w.deallocMap();
+    return true;
+}
+
+bool testTileFlags() {
+    std::cout << "Testing tile flags.\n";
+    World w;
+    TileDef wall = TileDef();
+    wall.ident = 7;
+    wall.solid = true;
+    wall.isWall = true;
+    w.addTileDef(wall);
+
+    const unsigned flags = TF_SOLID | TF_WALL;
+    if (!requireInt("flags before indexDefs", w.getTileFlags(7), flags)) return false;
+    w.indexDefs();
+    if (!requireInt("flags after indexDefs", w.getTileFlags(7), flags)) return false;
+    if (!requireInt("unknown tile", w.getTileFlags(8), 0)) return false;
+    return true;
+}
+
+// The map keeps idents in shorts, so larger ones are refused at load.
+bool testIdentRange() {
+    std::cout << "Testing ident range.\n";
+    const char *filename = "test_ident_range.dat";
+    const std::string text = "item {\n    ident 40000\n    name \"wide\"\n};\n";
+    PHYSFS_File *out = PHYSFS_openWrite(filename);
+    if (!requireInt("write data file", out != nullptr, true)) return false;
+    PHYSFS_writeBytes(out, text.data(), text.size());
+    PHYSFS_close(out);
+
+    World w;
+    bool loaded = loadGameData(w, filename);
+    PHYSFS_delete(filename);
+    if (!requireInt("load fails", loaded, false)) return false;
+    if (!requireInt("item not added", w.itemDefCount(), 0)) return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    const std::string writeDir = makeTempDir();
+    if (writeDir.empty() || !PHYSFS_setWriteDir(writeDir.c_str())) {
+        std::cout << "Failed to set write directory.\n";
+        return 1;
+    }
+    PHYSFS_mount(".", "/", true);
+    PHYSFS_mount(writeDir.c_str(), "/data", true);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cout << "Failed to load game data.\n";
+        return 1;
+    }
+
+    if (!testStacks(w)) return 1;
+    if (!testTileFlags()) return 1;
+    if (!testIdentRange()) return 1;
+    std::cout << "All tests passed.\n";
+
+    PHYSFS_deinit();
+    removeTempDir(writeDir);
+    return 0;
+}
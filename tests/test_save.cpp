@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <physfs.h>
+#include "test.h"
+#include "../src/save_buffer.h"
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+const char *SAVE_FILE = "test.sav";
+const char *TRUNCATED_FILE = "test_truncated.sav";
+
+
+unsigned long long hashWorld(World &w) {
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&hash](long long value) {
+        hash ^= static_cast<unsigned long long>(value);
+        hash *= 1099511628211ull;
+    };
+    mix(w.width());
+    mix(w.height());
+    for (int y = 0; y < w.height(); ++y) {
+        for (int x = 0; x < w.width(); ++x) {
+            Point p(x, y);
+            const Tile &tile = w.at(p);
+            mix(tile.terrain);
+            mix(tile.building);
+            mix(tile.item.empty() ? -1 : tile.item.ident);
+            mix(tile.item.qty);
+            mix(tile.room ? tile.room->type : -1);
+            const Actor *actor = tile.actor;
+            mix(actor ? actor->def.ident : -1);
+            if (actor) {
+                mix(w.getActorAge(actor));
+                mix(actor->health);
+                mix(actor->inventory.size());
+            }
+        }
+    }
+    return hash;
+}
+
+long long saveSize() {
+    PHYSFS_Stat stat;
+    if (!PHYSFS_stat((std::string("/save/") + SAVE_FILE).c_str(), &stat)) return -1;
+    return stat.filesize;
+}
+
+bool copyPrefix(const std::string &from, const std::string &to, long long bytes) {
+    PHYSFS_File *inf = PHYSFS_openRead(("/save/" + from).c_str());
+    if (!inf) return false;
+    std::vector<char> data(bytes);
+    bool good = PHYSFS_readBytes(inf, data.data(), bytes) == bytes;
+    PHYSFS_close(inf);
+    PHYSFS_File *out = PHYSFS_openWrite(to.c_str());
+    if (!out) return false;
+    good = good && PHYSFS_writeBytes(out, data.data(), bytes) == bytes;
+    PHYSFS_close(out);
+    return good;
+}
+
+bool testRoundTrip(World &w, int size, bool compress) {
+    std::cout << "Testing " << (compress ? "compressed" : "uncompressed") << " save and load at size " << size << ".\n";
+    w.setSaveCompression(compress);
+    w.allocMap(size, size);
+    buildmap(w, size, 1);
+    w.getRandom().seed(size);
+    for (int i = 0; i < 50; ++i) {
+        w.tick();
+    }
+    w.dropItems(Point(size / 2, size / 2), 1, 5);
+    unsigned long long before = hashWorld(w);
+    const int turn = w.getTurn();
+
+    if (!requireInt("save succeeds", w.savegame(SAVE_FILE), true)) return false;
+    w.deallocMap();
+    if (!requireInt("load succeeds", w.loadgame(SAVE_FILE), true)) return false;
+    if (!requireInt("turn restored", w.getTurn(), turn)) return false;
+    if (!requireUnsignedLongLong("world restored", hashWorld(w), before)) return false;
+    w.deallocMap();
+    return true;
+}
+
+// Saving again to the same file appends the changes; loading must give back
+// the same world as a full save would.
+bool testDeltas(World &w, bool compress) {
+    std::cout << "Testing " << (compress ? "compressed" : "uncompressed") << " change records.\n";
+    const int TILE_WOOD_WALL = 104;
+    const int ITEM_ROCK = 1;
+    w.setSaveCompression(compress);
+    w.allocMap(256, 256);
+    buildmap(w, 31, 1);
+    w.getRandom().seed(31);
+    w.getPlayer()->health = 1000000000;
+    if (!requireInt("full save", w.savegame(SAVE_FILE), true)) return false;
+    const long long baseSize = saveSize();
+
+    long long lastSize = baseSize;
+    // few enough that the changes stay well under the size that compacts
+    for (unsigned i = 0; i < 4; ++i) {
+        for (int t = 0; t < 10; ++t) w.tick();
+        const Point corner(40 + i * 10, 40 + i * 5);
+        w.fillRect(LAYER_BUILDING, corner, 3, 3, TILE_WOOD_WALL);
+        w.dropItems(Point(corner.x + 5, corner.y + 5), ITEM_ROCK, 3);
+        w.getPlayer()->inventory.add(&w.getItemDef(ITEM_ROCK), 1);
+        if (!requireInt("change save", w.savegame(SAVE_FILE), true)) return false;
+        if (!requireInt("file grows", saveSize() > lastSize, true)) return false;
+        lastSize = saveSize();
+    }
+    if (!requireInt("changes smaller than full save", lastSize - baseSize < baseSize, true)) return false;
+    unsigned long long before = hashWorld(w);
+    const int turn = w.getTurn();
+
+    World loaded;
+    loadGameData(loaded, "game.dat");
+    loaded.selection = 0;
+    if (!requireInt("load with changes", loaded.loadgame(SAVE_FILE), true)) return false;
+    if (!requireInt("turn after changes", loaded.getTurn(), turn)) return false;
+    if (!requireUnsignedLongLong("world after changes", hashWorld(loaded), before)) return false;
+    if (!requireInt("player restored", loaded.getPlayer() != nullptr, true)) return false;
+
+    if (!requireInt("compacting save", loaded.savegame(SAVE_FILE, true), true)) return false;
+    if (!requireInt("compacted size", saveSize() < lastSize, true)) return false;
+    if (!requireInt("load compacted", w.loadgame(SAVE_FILE), true)) return false;
+    if (!requireUnsignedLongLong("world after compacting", hashWorld(w), before)) return false;
+    w.deallocMap();
+    return true;
+}
+
+// An autosave holds the world as it was when it started, however far the
+// game has gone on by the time the background write finishes.
+bool testAutosave(World &w) {
+    std::cout << "Testing autosave.\n";
+    w.setSaveCompression(true);
+    w.allocMap(256, 256);
+    buildmap(w, 37, 1);
+    w.getRandom().seed(37);
+    w.getPlayer()->health = 1000000000;
+    // the first is a full save and the rest are change records
+    for (int i = 0; i < 3; ++i) {
+        for (int t = 0; t < 10; ++t) w.tick();
+        const unsigned long long before = hashWorld(w);
+        if (!requireInt("autosave started", w.autosave(SAVE_FILE), true)) return false;
+        for (int t = 0; t < 10; ++t) w.tick();
+        w.finishAutosave(true);
+
+        World loaded;
+        loadGameData(loaded, "game.dat");
+        loaded.selection = 0;
+        if (!requireInt("load autosave", loaded.loadgame(SAVE_FILE), true)) return false;
+        if (!requireUnsignedLongLong("world at autosave", hashWorld(loaded), before)) return false;
+    }
+
+    if (!requireInt("autosave started", w.autosave("missing/test.sav"), true)) return false;
+    w.finishAutosave(true);
+    if (!requireString("failure reported", w.getLogMsg(0).msg, "Autosave failed.")) return false;
+    w.deallocMap();
+    return true;
+}
+
+// Waiting is all a journaled command does here, since the handlers that
+// carry out the rest live in the game.
+int replayedAnswers = 0;
+bool replayWait(World &w, Actor *player, const Command &command, bool silent) {
+    Dir answer;
+    if (w.replayAnswer(answer) && answer != Dir::None) ++replayedAnswers;
+    return true;
+}
+ActionHandler waitOnly(int command) {
+    return command == CMD_WAIT ? replayWait : nullptr;
+}
+
+// Commands journaled after a save come back with the save, and giving them
+// again with the journaled random state brings the world to where it was.
+bool testJournal(World &w) {
+    std::cout << "Testing the journal.\n";
+    w.allocMap(256, 256);
+    buildmap(w, 41, 1);
+    w.getRandom().seed(41);
+    w.getPlayer()->health = 1000000000;
+    if (!requireInt("save before journal", w.savegame(SAVE_FILE), true)) return false;
+
+    const int JOURNALED = 6;
+    for (int i = 0; i < JOURNALED; ++i) {
+        JournalEntry entry = w.startJournalEntry(Command{ CMD_WAIT });
+        if (i == 2) w.journalAnswer(Dir::East);
+        w.journalCommand(entry);
+        w.tick();
+        w.flushJournal();
+    }
+    const unsigned long long before = hashWorld(w);
+    const unsigned turn = w.getTurn();
+    // waits for the journal to be written
+    w.deallocMap();
+
+    World loaded;
+    loadGameData(loaded, "game.dat");
+    loaded.selection = 0;
+    if (!requireInt("load with journal", loaded.loadgame(SAVE_FILE), true)) return false;
+    std::vector<JournalEntry> entries;
+    loaded.readJournal(entries);
+    if (!requireInt("journaled commands", entries.size(), JOURNALED)) return false;
+    if (!requireInt("journaled answers", entries[2].answers.size(), 1)) return false;
+    replayedAnswers = 0;
+    if (!requireInt("whole journal replayed", replayJournal(loaded, SAVE_FILE, waitOnly), true)) return false;
+    if (!requireInt("answer while replaying", replayedAnswers, 1)) return false;
+    if (!requireInt("turn after replay", loaded.getTurn(), turn)) return false;
+    if (!requireUnsignedLongLong("world after replay", hashWorld(loaded), before)) return false;
+
+    // a new save starts the journal over
+    if (!requireInt("save after replay", loaded.savegame(SAVE_FILE), true)) return false;
+    loaded.deallocMap();
+    if (!requireInt("load without journal", loaded.loadgame(SAVE_FILE), true)) return false;
+    if (!requireInt("journal restarted", loaded.readJournal(entries), false)) return false;
+    return true;
+}
+
+// A replay that stops partway saves the world as it got it to, over the
+// save it was loaded from, so the rest of the journal is dropped.
+bool testPartialReplay(World &w) {
+    std::cout << "Testing a partial journal replay.\n";
+    const char *partialFile = "test_partial.sav";
+    w.allocMap(128, 128);
+    buildmap(w, 43, 1);
+    w.getPlayer()->health = 1000000000;
+    if (!requireInt("save before journal", w.savegame(partialFile), true)) return false;
+    for (int i = 0; i < 5; ++i) {
+        // the fourth can't be given again without the game's handlers
+        JournalEntry entry = w.startJournalEntry(Command{ i == 3 ? CMD_SORT_INV_NAME : CMD_WAIT });
+        w.journalCommand(entry);
+        w.tick();
+        w.flushJournal();
+    }
+    w.deallocMap();
+
+    World loaded;
+    loadGameData(loaded, "game.dat");
+    loaded.selection = 0;
+    if (!requireInt("load with journal", loaded.loadgame(partialFile), true)) return false;
+    const unsigned start = loaded.getTurn();
+    if (!requireInt("partial replay", replayJournal(loaded, partialFile, waitOnly), false)) return false;
+    if (!requireInt("stopped at unknown command", loaded.getTurn(), start + 3)) return false;
+    const unsigned long long replayed = hashWorld(loaded);
+    loaded.deallocMap();
+
+    if (!requireInt("reload", loaded.loadgame(partialFile), true)) return false;
+    std::vector<JournalEntry> entries;
+    if (!requireInt("journal dropped", loaded.readJournal(entries), false)) return false;
+    if (!requireInt("saved where replay stopped", loaded.getTurn(), start + 3)) return false;
+    if (!requireUnsignedLongLong("saved world", hashWorld(loaded), replayed)) return false;
+    loaded.deallocMap();
+    PHYSFS_delete(partialFile);
+    PHYSFS_delete("test_partial.jnl");
+    return true;
+}
+
+// The reader maps saves where it can; either way it must see the same bytes
+// as a plain PhysFS read.
+bool testReader() {
+    std::cout << "Testing save reader.\n";
+    const std::string path = std::string("/save/") + SAVE_FILE;
+    SaveReader reader;
+    if (!requireInt("reader opens save", reader.readFile(path), true)) return false;
+    PHYSFS_File *inf = PHYSFS_openRead(path.c_str());
+    if (!requireInt("physfs opens save", inf != nullptr, true)) return false;
+    std::vector<unsigned char> data(PHYSFS_fileLength(inf));
+    PHYSFS_readBytes(inf, data.data(), data.size());
+    PHYSFS_close(inf);
+    if (!requireInt("same size", reader.size(), data.size())) return false;
+    if (!requireInt("same bytes", std::equal(data.begin(), data.end(), reader.data()), true)) return false;
+
+    SaveReader moved(std::move(reader));
+    if (!requireInt("move keeps data", moved.size(), data.size())) return false;
+    if (!requireInt("moved from is empty", reader.size(), 0)) return false;
+    if (!requireInt("missing file", reader.readFile("/save/no_such.sav"), false)) return false;
+    return true;
+}
+
+bool testTruncated(World &w) {
+    std::cout << "Testing truncated saves.\n";
+    PHYSFS_Stat stat;
+    if (!requireInt("save exists", PHYSFS_stat((std::string("/save/") + SAVE_FILE).c_str(), &stat), true)) return false;
+    const long long cuts[] = { 4, 40, stat.filesize / 2, stat.filesize - 1 };
+    for (long long cut : cuts) {
+        if (!requireInt("copy prefix", copyPrefix(SAVE_FILE, TRUNCATED_FILE, cut), true)) return false;
+        if (!requireInt("load fails at " + std::to_string(cut), w.loadgame(TRUNCATED_FILE), false)) return false;
+    }
+    w.deallocMap();
+    PHYSFS_delete(TRUNCATED_FILE);
+    PHYSFS_delete(SAVE_FILE);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    const std::string writeDir = makeTempDir();
+    if (writeDir.empty() || !PHYSFS_setWriteDir(writeDir.c_str())) {
+        std::cout << "Failed to set write directory.\n";
+        return 1;
+    }
+    PHYSFS_mount(".", "/", true);
+    PHYSFS_mount(writeDir.c_str(), "/save", false);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cout << "Failed to load game data.\n";
+        return 1;
+    }
+    w.selection = 0;
+
+    if (!testRoundTrip(w, 256, false)) return 1;
+    if (!testRoundTrip(w, 300, false)) return 1;
+    if (!testReader()) return 1;
+    if (!testTruncated(w)) return 1;
+    if (!testRoundTrip(w, 256, true)) return 1;
+    if (!testRoundTrip(w, 300, true)) return 1;
+    if (!testTruncated(w)) return 1;
+    if (!testDeltas(w, false)) return 1;
+    if (!testDeltas(w, true)) return 1;
+    if (!testAutosave(w)) return 1;
+    if (!testJournal(w)) return 1;
+    if (!testPartialReplay(w)) return 1;
+    std::cout << "All tests passed.\n";
+
+    PHYSFS_deinit();
+    removeTempDir(writeDir);
+    return 0;
+}
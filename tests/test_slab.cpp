@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../src/world.h"
+
+
+struct Counted {
+    Counted(int value, int &live) : value(value), live(live) { ++live; }
+    ~Counted() { --live; }
+    int value;
+    int &live;
+};
+
+bool testHandles() {
+    std::cout << "Testing slab handles.\n";
+    int live = 0;
+    Slab<Counted> slab;
+
+    if (!requireInt("handle 0 is empty", slab.get(0) == nullptr, true)) return false;
+    unsigned first = slab.create(1, live);
+    unsigned second = slab.create(2, live);
+    if (!requireInt("first handle resolves", slab.get(first)->value, 1)) return false;
+    if (!requireInt("second handle resolves", slab.get(second)->value, 2)) return false;
+    if (!requireInt("count after create", slab.size(), 2)) return false;
+
+    if (!requireInt("destroy live handle", slab.destroy(first), true)) return false;
+    if (!requireInt("destructor ran", live, 1)) return false;
+    if (!requireInt("destroyed handle is stale", slab.get(first) == nullptr, true)) return false;
+    if (!requireInt("destroy stale handle", slab.destroy(first), false)) return false;
+
+    unsigned reused = slab.create(3, live);
+    if (!requireInt("freed slot is reused", reused & Slab<Counted>::INDEX_MASK, first & Slab<Counted>::INDEX_MASK)) return false;
+    if (!requireInt("reused slot has new handle", reused != first, true)) return false;
+    if (!requireInt("old handle stays stale", slab.get(first) == nullptr, true)) return false;
+    if (!requireInt("new handle resolves", slab.get(reused)->value, 3)) return false;
+
+    slab.clear();
+    if (!requireInt("clear runs destructors", live, 0)) return false;
+    if (!requireInt("clear empties slab", slab.size(), 0)) return false;
+    if (!requireInt("handles stale after clear", slab.get(second) == nullptr, true)) return false;
+    unsigned after = slab.create(4, live);
+    if (!requireInt("handle after clear differs", after != first && after != second, true)) return false;
+    return true;
+}
+
+// Reusing one slot more times than the generation can count must not bring
+// an old handle back to life.
+bool testGenerationWrap() {
+    std::cout << "Testing slab generation wrap.\n";
+    int live = 0;
+    Slab<Counted> slab;
+    unsigned first = slab.create(0, live);
+    unsigned handle = first;
+    for (unsigned i = 1; i <= Slab<Counted>::GENERATION_MAX + 10; ++i) {
+        slab.destroy(handle);
+        handle = slab.create(i, live);
+        if (!requireInt("first handle stays stale", slab.get(first) == nullptr, true)) return false;
+        if (!requireInt("new handle resolves", slab.get(handle)->value, i)) return false;
+    }
+    if (!requireInt("retired slot not reused", (handle & Slab<Counted>::INDEX_MASK) != (first & Slab<Counted>::INDEX_MASK), true)) return false;
+
+    slab.clear();
+    for (int i = 0; i < 4; ++i) {
+        handle = slab.create(i, live);
+        if (!requireInt("retired slot skipped after clear", (handle & Slab<Counted>::INDEX_MASK) != (first & Slab<Counted>::INDEX_MASK), true)) return false;
+    }
+    if (!requireInt("first handle stale after clear", slab.get(first) == nullptr, true)) return false;
+    return true;
+}
+
+bool testStablePointers() {
+    std::cout << "Testing slab pointer stability.\n";
+    int live = 0;
+    Slab<Counted> slab;
+    std::vector<unsigned> handles;
+    unsigned firstHandle = slab.create(0, live);
+    const Counted *firstObject = slab.get(firstHandle);
+    for (int i = 1; i < 5000; ++i) {
+        handles.push_back(slab.create(i, live));
+    }
+    if (!requireInt("object does not move as slab grows", slab.get(firstHandle) == firstObject, true)) return false;
+    for (unsigned i = 0; i < handles.size(); ++i) {
+        if (!requireInt("object " + std::to_string(i + 1), slab.get(handles[i])->value, i + 1)) return false;
+    }
+    return true;
+}
+
+int main() {
+    if (!testHandles())         return 1;
+    if (!testGenerationWrap())  return 1;
+    if (!testStablePointers())  return 1;
+    std::cout << "All tests passed.\n";
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <physfs.h>
+#include "test.h"
+#include "../src/world.h"
+
+bool loadGameData(World &w, const std::string &filename);
+bool buildmap(World &w, unsigned long seed, unsigned threads = 0);
+
+
+unsigned long long hashTicks(World &w, int size, unsigned long seed, int ticks, unsigned threads,
+                             int simRadius = 0, int simFar = 1) {
+    w.allocMap(size, size);
+    buildmap(w, seed, 1);
+    w.getRandom().seed(seed);
+    // a respawn would move the player somewhere that depends on nothing under test
+    w.getPlayer()->health = 1000000000;
+    w.setTickThreads(threads);
+    w.setSimulationLod(simRadius, simFar);
+    for (int i = 0; i < ticks; ++i) {
+        w.tick();
+    }
+
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&hash](long long value) {
+        hash ^= static_cast<unsigned long long>(value);
+        hash *= 1099511628211ull;
+    };
+    for (int y = 0; y < w.height(); ++y) {
+        for (int x = 0; x < w.width(); ++x) {
+            Point p(x, y);
+            mix(w.getTerrain(p));
+            mix(w.getBuilding(p));
+            const Actor *actor = w.at(p).actor;
+            mix(actor ? actor->def.ident : -1);
+            mix(actor ? w.getActorAge(actor) : 0);
+            mix(actor ? actor->health : 0);
+            ItemStack stack = w.at(p).item;
+            mix(stack.ident);
+            mix(stack.qty);
+        }
+    }
+    mix(w.actorCount());
+    mix(w.itemCount());
+    w.deallocMap();
+    w.setSimulationLod(0, 1);
+    return hash;
+}
+
+bool testThreadCounts(World &w) {
+    std::cout << "Testing tick results across thread counts.\n";
+    const int size = 256;
+    const unsigned long seed = 777;
+    const int ticks = 200;
+    unsigned many = std::thread::hardware_concurrency();
+    if (many < 4) many = 4;
+
+    unsigned long long single = hashTicks(w, size, seed, ticks, 1);
+    if (!requireUnsignedLongLong("same world on 1 thread twice", hashTicks(w, size, seed, ticks, 1), single)) return false;
+    if (!requireUnsignedLongLong("same world on 2 threads", hashTicks(w, size, seed, ticks, 2), single)) return false;
+    if (!requireUnsignedLongLong("same world on " + std::to_string(many) + " threads", hashTicks(w, size, seed, ticks, many), single)) return false;
+    return true;
+}
+
+Actor* placeActor(World &w, int ident, const Point &p) {
+    Actor *actor = w.createActor(w.getActorDef(ident));
+    actor->reset();
+    w.moveActor(actor, p);
+    return actor;
+}
+
+// A monster plans to attack its neighbour, which walks away before the
+// attack is applied; an ally of the monster then steps into that square.
+// The attack must not land on the ally.
+bool testAttackTarget() {
+    std::cout << "Testing attack targets.\n";
+    const int ACTOR_PLAYER = 1;
+    const int ACTOR_PIG = 3;
+    const int ACTOR_CHICKEN = 4;
+    const int ACTOR_ZOMBIE = 2000;
+    const int ITEM_WHEAT_SEED = 15;
+    const int ITEM_CARROT = 18;
+    World w;
+    if (!requireInt("load game data", loadGameData(w, "game.dat"), true)) return false;
+    // copies that act every turn, so the tick plays out the same way each run
+    const int idents[] = { ACTOR_PIG, ACTOR_CHICKEN, ACTOR_ZOMBIE };
+    for (int i = 0; i < 3; ++i) {
+        ActorDef def = w.getActorDef(idents[i]);
+        def.ident = 9000 + i;
+        def.moveChance = 1000;
+        def.loot = nullptr;
+        w.addActorDef(def);
+    }
+    w.indexDefs();
+
+    w.allocMap(64, 64);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 64, 64, TILE_DIRT);
+    w.finishBulkEdit();
+    placeActor(w, ACTOR_PLAYER, Point(50, 50));
+    w.getPlayer()->health = 1000000000;
+    // listed in the order they act: the victim, the ally, then the attacker
+    Actor *victim = placeActor(w, 9000, Point(11, 10));
+    Actor *ally = placeActor(w, 9001, Point(11, 11));
+    Actor *attacker = placeActor(w, 9002, Point(10, 10));
+    victim->faction = 0;
+    ally->faction = attacker->faction;
+    w.dropItems(Point(12, 10), ITEM_CARROT, 1);
+    w.dropItems(Point(11, 8), ITEM_WHEAT_SEED, 1);
+
+    w.tick();
+    if (!requireInt("victim walked off", victim->pos == Point(12, 10), true)) return false;
+    if (!requireInt("ally stepped in", ally->pos == Point(11, 10), true)) return false;
+    if (!requireInt("ally not attacked", ally->health, ally->def.health)) return false;
+    if (!requireInt("victim out of reach", victim->health, victim->def.health)) return false;
+    w.deallocMap();
+    return true;
+}
+
+bool testLod(World &w) {
+    std::cout << "Testing simulation LOD.\n";
+    const int size = 256;
+    const unsigned long seed = 777;
+    const int ticks = 100;
+    unsigned long long full = hashTicks(w, size, seed, ticks, 1);
+    if (!requireUnsignedLongLong("radius covering map matches full simulation", hashTicks(w, size, seed, ticks, 1, size, 8), full)) return false;
+
+    unsigned long long lod = hashTicks(w, size, seed, ticks, 1, 32, 8);
+    if (!requireInt("small radius changes results", lod != full, true)) return false;
+    if (!requireUnsignedLongLong("same LOD results on 1 thread twice", hashTicks(w, size, seed, ticks, 1, 32, 8), lod)) return false;
+    if (!requireUnsignedLongLong("same LOD results on 4 threads", hashTicks(w, size, seed, ticks, 4, 32, 8), lod)) return false;
+    return true;
+}
+
+// Each distant actor acts once every far interval, on the same turns even
+// when actors listed ahead of it are removed.
+bool testLodPhase(World &w) {
+    std::cout << "Testing simulation LOD turn order.\n";
+    const int ACTOR_PLAYER = 1;
+    const int ACTOR_KOBOLD = 2;
+    const unsigned interval = 4;
+    w.allocMap(64, 64);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 64, 64, TILE_DIRT);
+    w.finishBulkEdit();
+    Actor *player = placeActor(w, ACTOR_PLAYER, Point(1, 1));
+    player->health = 1000000000;
+    std::vector<Actor*> kobolds;
+    for (int i = 0; i < 12; ++i) {
+        kobolds.push_back(placeActor(w, ACTOR_KOBOLD, Point(20 + (i % 4) * 10, 20 + (i / 4) * 10)));
+    }
+    w.setSimulationLod(2, interval);
+
+    std::vector<unsigned> phases(kobolds.size(), interval);
+    for (unsigned t = 0; t < interval * 4; ++t) {
+        if (t == interval * 2) {
+            for (int i = 0; i < 6; i += 2) {
+                w.removeActor(kobolds[i]);
+                kobolds[i] = nullptr;
+            }
+        }
+        w.tick();
+        for (unsigned i = 0; i < kobolds.size(); ++i) {
+            if (!kobolds[i] || kobolds[i]->ageTurn != w.getTurn()) continue;
+            if (phases[i] == interval) phases[i] = w.getTurn() % interval;
+            if (!requireInt("far actor keeps its turn", w.getTurn() % interval, phases[i])) return false;
+        }
+    }
+    for (unsigned i = 0; i < kobolds.size(); ++i) {
+        if (kobolds[i] && !requireInt("far actor acted", phases[i] < interval, true)) return false;
+    }
+    w.setSimulationLod(0, 1);
+    w.deallocMap();
+    return true;
+}
+
+bool testRemoval(World &w) {
+    std::cout << "Testing actor removal.\n";
+    const int ACTOR_PLAYER = 1;
+    const int ACTOR_KOBOLD = 2;
+    w.allocMap(32, 32);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 32, 32, TILE_DIRT);
+    w.finishBulkEdit();
+    Actor *player = placeActor(w, ACTOR_PLAYER, Point(16, 16));
+    std::vector<Actor*> kobolds;
+    for (int i = 0; i < 10; ++i) {
+        kobolds.push_back(placeActor(w, ACTOR_KOBOLD, Point(2 + i * 2, 4)));
+    }
+    unsigned removedHandle = kobolds[0]->handle;
+    for (int i = 0; i < 10; i += 2) {
+        w.removeActor(kobolds[i]);
+    }
+    w.removeActor(player);
+    if (!requireInt("removed actor is off the map", w.at(Point(2, 4)).actor == nullptr, true)) return false;
+    if (!requireInt("removed actor kept until tick", w.getActor(removedHandle) == kobolds[0], true)) return false;
+
+    w.tick();
+    if (!requireInt("removed actors purged", w.actorCount(), 6)) return false;
+    if (!requireInt("purged handle is stale", w.getActor(removedHandle) == nullptr, true)) return false;
+    if (!requireInt("player respawned", player->dead, false)) return false;
+    if (!requireInt("player back on map", w.at(player->pos).actor == player, true)) return false;
+    w.tick();
+    if (!requireInt("player listed once", w.actorCount(), 6)) return false;
+    w.deallocMap();
+    return true;
+}
+
+bool testGrowth(World &w) {
+    std::cout << "Testing plant growth.\n";
+    const int ACTOR_PLAYER = 1;
+    const int ACTOR_WHEAT_SEEDLING = 1004;
+    const int ACTOR_GROWN_WHEAT = 1005;
+    w.allocMap(32, 32);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 32, 32, TILE_DIRT);
+    w.finishBulkEdit();
+    placeActor(w, ACTOR_PLAYER, Point(30, 30));
+    const Point early(4, 4), late(8, 8);
+    placeActor(w, ACTOR_WHEAT_SEEDLING, early);
+    const int growTime = w.getActorDef(ACTOR_WHEAT_SEEDLING).growTime;
+
+    for (int i = 0; i < 5; ++i) w.tick();
+    placeActor(w, ACTOR_WHEAT_SEEDLING, late);
+    for (int i = 5; i < growTime - 1; ++i) w.tick();
+    if (!requireInt("seedling still growing", w.at(early).actor->def.ident, ACTOR_WHEAT_SEEDLING)) return false;
+    if (!requireInt("seedling age", w.getActorAge(w.at(early).actor), growTime - 1)) return false;
+    w.tick();
+    if (!requireInt("seedling grown on time", w.at(early).actor->def.ident, ACTOR_GROWN_WHEAT)) return false;
+    if (!requireInt("grown plant starts at age 0", w.getActorAge(w.at(early).actor), 0)) return false;
+    if (!requireInt("later seedling still growing", w.at(late).actor->def.ident, ACTOR_WHEAT_SEEDLING)) return false;
+    for (int i = 0; i < 5; ++i) w.tick();
+    if (!requireInt("later seedling grown", w.at(late).actor->def.ident, ACTOR_GROWN_WHEAT)) return false;
+    if (!requireInt("plants replaced, not added", w.actorCount(), 3)) return false;
+    w.deallocMap();
+    return true;
+}
+
+bool testRest(World &w) {
+    std::cout << "Testing rest.\n";
+    const int ACTOR_PLAYER = 1;
+    const int ACTOR_WHEAT_SEEDLING = 1004;
+    const int ACTOR_ZOMBIE = 2000;
+    const unsigned stopOn = REST_ON_HOSTILE | REST_ON_DAMAGE | REST_ON_CROP;
+    w.allocMap(64, 64);
+    w.fillRect(LAYER_TERRAIN, Point(0, 0), 64, 64, TILE_DIRT);
+    w.finishBulkEdit();
+    placeActor(w, ACTOR_PLAYER, Point(32, 32));
+
+    RestResult result = w.rest(10, stopOn, 8, nullptr);
+    if (!requireInt("quiet rest finishes", result.reason, REST_FINISHED)) return false;
+    if (!requireInt("quiet rest length", result.turns, 10)) return false;
+
+    unsigned start = w.getTurn();
+    placeActor(w, ACTOR_WHEAT_SEEDLING, Point(30, 30));
+    placeActor(w, ACTOR_WHEAT_SEEDLING, Point(50, 50));
+    result = w.rest(100, stopOn, 8, nullptr);
+    if (!requireInt("nearby crop stops rest", result.reason, REST_CROP)) return false;
+    if (!requireInt("crop stops rest on time", w.getTurn() - start,
+                    w.getActorDef(ACTOR_WHEAT_SEEDLING).growTime)) return false;
+
+    placeActor(w, ACTOR_ZOMBIE, Point(36, 32));
+    result = w.rest(100, stopOn, 8, nullptr);
+    if (!requireInt("monster nearby prevents rest", result.reason, REST_HOSTILE)) return false;
+    if (!requireInt("no turns with monster nearby", result.turns, 0)) return false;
+    result = w.rest(100, REST_ON_DAMAGE, 8, nullptr);
+    if (!requireInt("monster attack stops rest", result.reason, REST_DAMAGED)) return false;
+    w.deallocMap();
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    PHYSFS_init(argv[0]);
+    PHYSFS_mount(".", "/", true);
+    World w;
+    if (!loadGameData(w, "game.dat")) {
+        std::cout << "Failed to load game data.\n";
+        return 1;
+    }
+    w.selection = 0;
+
+    if (!testThreadCounts(w)) return 1;
+    if (!testAttackTarget()) return 1;
+    if (!testLod(w)) return 1;
+    if (!testLodPhase(w)) return 1;
+    if (!testRemoval(w)) return 1;
+    if (!testGrowth(w)) return 1;
+    if (!testRest(w)) return 1;
+    std::cout << "All tests passed.\n";
+
+    PHYSFS_deinit();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "../src/timing_wheel.h"
+
+
+// Advances one turn at a time from start and records the turn each value
+// comes due on.
+std::vector<unsigned> runWheel(unsigned start, const std::vector<unsigned> &dues, unsigned until) {
+    TimingWheel wheel;
+    wheel.reset(start);
+    for (unsigned i = 0; i < dues.size(); ++i) {
+        wheel.schedule(dues[i], i);
+    }
+    std::vector<unsigned> firedAt(dues.size(), 0);
+    std::vector<unsigned> due;
+    for (unsigned turn = start + 1; turn <= until; ++turn) {
+        due.clear();
+        wheel.advance(turn, due);
+        for (unsigned value : due) firedAt[value] = turn;
+    }
+    return firedAt;
+}
+
+bool testDueTurns() {
+    std::cout << "Testing timing wheel due turns.\n";
+    const unsigned start = 250;
+    const std::vector<unsigned> dues = { 251, 255, 256, 300, 511, 512, 70000, 0 };
+    std::vector<unsigned> firedAt = runWheel(start, dues, 70100);
+    for (unsigned i = 0; i + 1 < dues.size(); ++i) {
+        if (!requireInt("event due on " + std::to_string(dues[i]), firedAt[i], dues[i])) return false;
+    }
+    if (!requireInt("overdue event fires on next turn", firedAt.back(), start + 1)) return false;
+    return true;
+}
+
+bool testOrderAndJumps() {
+    std::cout << "Testing timing wheel ordering.\n";
+    TimingWheel wheel;
+    wheel.reset(10);
+    wheel.schedule(400, 1);
+    wheel.schedule(20, 2);
+    wheel.schedule(400, 3);
+    wheel.schedule(15, 4);
+    if (!requireInt("size counts events", wheel.size(), 4)) return false;
+
+    std::vector<unsigned> due;
+    wheel.advance(14, due);
+    if (!requireInt("nothing due yet", due.size(), 0)) return false;
+    wheel.advance(500, due);
+    if (!requireInt("all due after jump", due.size(), 4)) return false;
+    if (!requireInt("earliest first", due[0], 4)) return false;
+    if (!requireInt("then next", due[1], 2)) return false;
+    if (!requireInt("same turn in schedule order", due[2], 1)) return false;
+    if (!requireInt("same turn in schedule order", due[3], 3)) return false;
+    if (!requireInt("wheel empty", wheel.size(), 0)) return false;
+    return true;
+}
+
+int main() {
+    if (!testDueTurns())        return 1;
+    if (!testOrderAndJumps())   return 1;
+    std::cout << "All tests passed.\n";
+    return 0;
+}